@@ -139,6 +139,52 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   block->write_cnt++;
 }
 
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK,
+   sector I into BUFFERS[I], each of which must have room for
+   BLOCK_SECTOR_SIZE bytes.  Devices that support it do so with a
+   single request rather than one per sector.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     void *const buffers[], size_t cnt)
+{
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  if (block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, buffers, cnt);
+  else
+    for (size_t i = 0; i < cnt; i++)
+      block->ops->read (block->aux, sector + i, buffers[i]);
+  block->read_cnt += cnt;
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK,
+   sector I from BUFFERS[I], each of which must contain
+   BLOCK_SECTOR_SIZE bytes.  Devices that support it do so with a
+   single request rather than one per sector.  Returns after the
+   block device has acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      void *const buffers[], size_t cnt)
+{
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, buffers, cnt);
+  else
+    for (size_t i = 0; i < cnt; i++)
+      block->ops->write (block->aux, sector + i, buffers[i]);
+  block->write_cnt += cnt;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -50,6 +50,10 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* Most sectors transferred by one READ or WRITE SECTOR command.
+   (A count of 0 would mean 256, which we avoid.) */
+#define MAX_SECTORS 255
+
 /* An ATA device. */
 struct ata_disk
   {
@@ -80,12 +84,16 @@ struct channel
 static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
+static void ide_read_multiple (void *, block_sector_t,
+                               void *const buffers[], size_t cnt);
+static void ide_write_multiple (void *, block_sector_t,
+                                void *const buffers[], size_t cnt);
 
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -344,16 +352,7 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_read_multiple (d_, sec_no, &buffer, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -363,37 +362,90 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    per-disk locking is unneeded. */
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  void *buffers[1] = { (void *) buffer };
+  ide_write_multiple (d_, sec_no, buffers, 1);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D, sector I into
+   BUFFERS[I].  Each command transfers up to MAX_SECTORS sectors;
+   the disk interrupts once per sector. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no,
+                   void *const buffers[], size_t cnt)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS ? cnt : MAX_SECTORS;
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+      for (size_t i = 0; i < n; i++)
+        {
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+                   sec_no + i);
+          input_sector (c, *buffers++);
+        }
+      sec_no += n;
+      cnt -= n;
+    }
+  lock_release (&c->lock);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D, sector I from
+   BUFFERS[I].  Returns after the disk has acknowledged receiving
+   all of the data. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no,
+                    void *const buffers[], size_t cnt)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS ? cnt : MAX_SECTORS;
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+      for (size_t i = 0; i < n; i++)
+        {
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+                   sec_no + i);
+          output_sector (c, *buffers++);
+          sema_down (&c->completion_wait);
+        }
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors CNT to transfer to the
+   disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
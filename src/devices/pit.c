@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,43 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts channel 0 counting down from COUNT in mode 0, so that
+   it raises interrupt line 0 once, COUNT cycles from now, and
+   then stays quiet until it is configured again.  A COUNT of 0
+   stands for 65536. */
+void
+pit_start_oneshot (uint16_t count)
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0x30);
+  outb (PIT_PORT_COUNTER (0), count);
+  outb (PIT_PORT_COUNTER (0), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the current count of CHANNEL, which must have been set
+   up by this module, and stores in *OUT whether the channel's
+   output is high.  In mode 0, the output goes high when the
+   count runs out. */
+uint16_t
+pit_read_count (int channel, bool *out)
+{
+  enum intr_level old_level;
+  uint8_t status, low, high;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Read-back command: latch the status and count of CHANNEL. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (1 << (channel + 1)));
+  status = inb (PIT_PORT_COUNTER (channel));
+  low = inb (PIT_PORT_COUNTER (channel));
+  high = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+
+  *out = (status & 0x80) != 0;
+  return (high << 8) | low;
+}
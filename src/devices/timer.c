@@ -24,7 +24,73 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* PIT cycles per timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Most ticks that one PIT count can span. */
+#define MAX_STOPPED_TICKS (65535 / TICK_CYCLES)
+
+/* Fewest PIT cycles a one-shot count is set for, about 54 us. */
+#define MIN_CYCLES 64
+
+#define NS_PER_SEC (1000 * 1000 * 1000)
+#define NS_PER_TICK (NS_PER_SEC / TIMER_FREQ)
+
+/* Shortest sub-tick sleep that blocks, in ns.  Shorter sleeps,
+   such as the disk driver's polls, busy-wait: a one-shot count of
+   at least MIN_CYCLES plus an interrupt and two thread switches
+   would take longer than the sleep itself. */
+#define MIN_BLOCK_NS (100 * 1000)
+
+/* Timer ticks to calibrate the TSC against. */
+#define CALIBRATE_TICKS 5
+
+/* Clocksource.  The time stamp counter counts CPU cycles.
+   timer_calibrate() measures its rate against the PIT, after
+   which timer_now_ns() reads the time from it to the
+   nanosecond. */
+static uint64_t tsc_hz;         /* TSC cycles per second, or 0. */
+static uint64_t tsc_base;       /* TSC at tsc_base_ns. */
+static int64_t tsc_base_ns;     /* Time when calibration ended. */
+
+/* One-shot timer interrupts.
+
+   Normally channel 0 of the PIT interrupts periodically, once
+   per tick.  It is switched to counting down once (mode 0)
+   when an interrupt is wanted at another time:
+
+     - For a thread that sleeps less than a tick, at its
+       deadline (see timer_arm_deadline()).
+
+     - With dynamic ticks, enabled by -nohz, when only the idle
+       thread can run: at the tick when the next sleeper wakes
+       up, as far as the 16-bit count reaches, skipping the
+       ticks in between (see timer_tick_stop()).  When a thread
+       becomes ready first, timer_tick_resume() shortens the
+       count to the next tick boundary.
+
+   The interrupt at the end of the count catches up on the tick
+   boundaries that went by, then counts to the next boundary or
+   deadline, and goes back to the periodic tick on a boundary.
+   Ticks are thus never lost and the tick count does not drift.
+   Boundaries are located by the PIT count itself: a one-shot
+   count started BOUNDARY cycles before a boundary. */
+bool timer_tickless;
+
+static bool oneshot;            /* Counting down once? */
+static uint32_t oneshot_cycles; /* Cycles in the one-shot count. */
+static uint32_t oneshot_boundary; /* Cycles to its first boundary. */
+static int64_t pending_idle;    /* Idle ticks before the count. */
+static bool stale_tick;         /* Periodic interrupt still pending? */
+static long long saved_ticks;   /* Tick interrupts not taken. */
+
 static intr_handler_func timer_interrupt;
+static void start_oneshot (uint32_t boundary, uint32_t cycles);
+static uint32_t oneshot_elapsed (void);
+static int64_t boundaries_passed (uint32_t elapsed);
+static uint32_t cycles_to_boundary (uint32_t elapsed);
+static uint32_t deadline_cycles (void);
+static uint64_t rdtsc (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -44,6 +110,8 @@ void
 timer_calibrate (void) 
 {
   unsigned high_bit, test_bit;
+  int64_t start;
+  uint64_t tsc_start;
 
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
@@ -64,6 +132,20 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  /* Count TSC cycles over CALIBRATE_TICKS ticks, starting just
+     after a tick. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  tsc_start = rdtsc ();
+  start = ticks;
+  while (ticks < start + CALIBRATE_TICKS)
+    barrier ();
+  tsc_base = rdtsc ();
+  tsc_base_ns = ticks * NS_PER_TICK;
+  tsc_hz = (tsc_base - tsc_start) * TIMER_FREQ / CALIBRATE_TICKS;
+  printf ("TSC: %'"PRIu64" Hz.\n", tsc_hz);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -71,11 +153,117 @@ int64_t
 timer_ticks (void) 
 {
   enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
+  int64_t t = ticks + stale_tick;
+  if (oneshot)
+    t += pending_idle + boundaries_passed (oneshot_elapsed ());
   intr_set_level (old_level);
   return t;
 }
 
+/* Returns the number of nanoseconds since the OS booted, to
+   within a tick until the TSC is calibrated. */
+int64_t
+timer_now_ns (void)
+{
+  uint64_t cycles;
+
+  if (tsc_hz == 0)
+    return timer_ticks () * NS_PER_TICK;
+
+  /* Split the division so that the product does not overflow. */
+  cycles = rdtsc () - tsc_base;
+  return (tsc_base_ns + cycles / tsc_hz * NS_PER_SEC
+          + cycles % tsc_hz * NS_PER_SEC / tsc_hz);
+}
+
+/* Makes sure the timer interrupts by the deadline of the next
+   thread sleeping less than a tick, if the next tick does not
+   come first.  Called with interrupts off after a thread starts
+   such a sleep. */
+void
+timer_arm_deadline (void)
+{
+  uint32_t cycles = deadline_cycles ();
+  uint32_t boundary;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (cycles == UINT32_MAX)
+    return;
+
+  if (oneshot)
+    {
+      uint32_t elapsed = oneshot_elapsed ();
+
+      /* The interrupt at the end of the count arms the deadline
+         if it comes first. */
+      if (oneshot_cycles - elapsed <= cycles)
+        return;
+      pending_idle += boundaries_passed (elapsed);
+      boundary = cycles_to_boundary (elapsed);
+    }
+  else
+    {
+      bool out;
+
+      /* Likewise for the periodic tick. */
+      boundary = pit_read_count (0, &out);
+      if (boundary <= cycles || boundary < MIN_CYCLES
+          || intr_ext_pending (0x20))
+        return;
+    }
+  start_oneshot (boundary, boundary);
+}
+
+/* Stops the periodic tick until tick WAKEUP, when the next
+   sleeper wakes up, if that is more than a tick away and dynamic
+   ticks are enabled.  Called by the idle thread with interrupts
+   off, when no other thread can run. */
+void
+timer_tick_stop (int64_t wakeup)
+{
+  uint32_t boundary;
+  int64_t n;
+  bool out;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!timer_tickless || oneshot || intr_ext_pending (0x20))
+    return;
+
+  n = wakeup - ticks;
+  if (n <= 1)
+    return;
+  if (n > MAX_STOPPED_TICKS)
+    n = MAX_STOPPED_TICKS;
+
+  /* The periodic count is the distance to the next tick. */
+  boundary = pit_read_count (0, &out);
+  if (boundary < MIN_CYCLES)
+    return;
+  start_oneshot (boundary, boundary + (n - 1) * TICK_CYCLES);
+}
+
+/* Brings the periodic tick back at the next tick boundary, if it
+   is stopped.  Called with interrupts off when a thread becomes
+   ready to run. */
+void
+timer_tick_resume (void)
+{
+  uint32_t elapsed, boundary;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!oneshot)
+    return;
+
+  elapsed = oneshot_elapsed ();
+  boundary = cycles_to_boundary (elapsed);
+  if (oneshot_cycles - elapsed <= boundary)
+    return;
+
+  /* Every tick so far went by idle. */
+  pending_idle += boundaries_passed (elapsed);
+  start_oneshot (boundary, boundary);
+}
+
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
 int64_t
@@ -163,14 +351,141 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %lld tick interrupts saved\n", saved_ticks);
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  thread_tick ();
+  if (oneshot && !stale_tick)
+    {
+      /* The one-shot count ran out.  All the ticks it spanned
+         but the last went by idle. */
+      int64_t passed = boundaries_passed (oneshot_cycles);
+      int64_t idle = pending_idle + (passed > 0 ? passed - 1 : 0);
+      uint32_t boundary = cycles_to_boundary (oneshot_cycles);
+
+      oneshot = false;
+      pending_idle = 0;
+      if (thread_wake_deadlines (timer_now_ns ()))
+        intr_yield_on_return ();
+
+      /* Set up the next interrupt before catching up, so that
+         the time that takes does not shift the ticks. */
+      if (boundary == TICK_CYCLES && deadline_cycles () >= TICK_CYCLES)
+        pit_configure_channel (0, 2, TIMER_FREQ);
+      else
+        start_oneshot (boundary, boundary);
+
+      saved_ticks += idle;
+      for (; idle > 0; idle--)
+        {
+          ticks++;
+          thread_tick_idle ();
+        }
+      if (passed > 0)
+        {
+          ticks++;
+          thread_tick ();
+        }
+    }
+  else
+    {
+      /* A periodic tick, perhaps one that was pending when the
+         one-shot count started. */
+      stale_tick = false;
+      ticks++;
+      thread_tick ();
+      if (thread_wake_deadlines (timer_now_ns ()))
+        intr_yield_on_return ();
+      timer_arm_deadline ();
+    }
+}
+
+/* Starts a one-shot count that runs out CYCLES from now, or at
+   the next sub-tick deadline if that is sooner, given that the
+   next tick boundary is BOUNDARY cycles away. */
+static void
+start_oneshot (uint32_t boundary, uint32_t cycles)
+{
+  uint32_t deadline = deadline_cycles ();
+  bool was_periodic = !oneshot;
+
+  ASSERT (boundary > 0 && boundary <= TICK_CYCLES);
+  if (deadline < cycles)
+    cycles = deadline;
+  ASSERT (cycles > 0 && cycles <= 65535);
+
+  pit_start_oneshot (cycles);
+  oneshot = true;
+  oneshot_cycles = cycles;
+  oneshot_boundary = boundary;
+
+  /* A periodic tick that came just before the switch is still to
+     be handled, and must not be taken for the end of the count. */
+  if (was_periodic && intr_ext_pending (0x20))
+    stale_tick = true;
+}
+
+/* Returns the PIT cycles since the one-shot count started. */
+static uint32_t
+oneshot_elapsed (void)
+{
+  bool out;
+  uint16_t count = pit_read_count (0, &out);
+
+  if (out || count > oneshot_cycles)
+    return oneshot_cycles;
+  return oneshot_cycles - count;
+}
+
+/* Returns the tick boundaries that passed in the first ELAPSED
+   cycles of the one-shot count. */
+static int64_t
+boundaries_passed (uint32_t elapsed)
+{
+  if (elapsed < oneshot_boundary)
+    return 0;
+  return 1 + (elapsed - oneshot_boundary) / TICK_CYCLES;
+}
+
+/* Returns the PIT cycles from ELAPSED cycles into the one-shot
+   count to the next tick boundary, between 1 and TICK_CYCLES. */
+static uint32_t
+cycles_to_boundary (uint32_t elapsed)
+{
+  if (elapsed < oneshot_boundary)
+    return oneshot_boundary - elapsed;
+  return TICK_CYCLES - (elapsed - oneshot_boundary) % TICK_CYCLES;
+}
+
+/* Returns the PIT cycles until the next sub-tick sleeper is due,
+   but at least MIN_CYCLES, or UINT32_MAX if there is none within
+   reach of a PIT count. */
+static uint32_t
+deadline_cycles (void)
+{
+  int64_t deadline = thread_next_deadline ();
+  int64_t ns, cycles;
+
+  if (deadline == INT64_MAX)
+    return UINT32_MAX;
+  ns = deadline - timer_now_ns ();
+  if (ns >= (int64_t) NS_PER_TICK * MAX_STOPPED_TICKS)
+    return UINT32_MAX;
+  cycles = ns * PIT_HZ / NS_PER_SEC;
+  return cycles < MIN_CYCLES ? MIN_CYCLES : cycles;
+}
+
+/* Reads the time stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -226,10 +541,17 @@ real_time_sleep (int64_t num, int32_t denom)
          processes. */                
       timer_sleep (ticks); 
     }
+  else if (tsc_hz != 0 && num * NS_PER_SEC / denom >= MIN_BLOCK_NS)
+    {
+      /* Otherwise, block until a one-shot timer interrupt at the
+         deadline, so that other threads can use the CPU. */
+      thread_sleep_ns (timer_now_ns () + num * NS_PER_SEC / denom);
+    }
   else 
     {
-      /* Otherwise, use a busy-wait loop for more accurate
-         sub-tick timing. */
+      /* Use a busy-wait loop for more accurate timing of short
+         sleeps, and of all sub-tick sleeps before the TSC is
+         calibrated. */
       real_time_delay (num, denom); 
     }
 }
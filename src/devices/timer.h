@@ -2,16 +2,26 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Stop the tick while idle? */
+extern bool timer_tickless;
+
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+int64_t timer_now_ns (void);
+
+/* One-shot interrupts. */
+void timer_arm_deadline (void);
+void timer_tick_stop (int64_t wakeup);
+void timer_tick_resume (void);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
@@ -157,6 +157,15 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns the sector that holds byte offset POS within INODE,
+   or -1 if INODE has no data at POS.  Lets swap do I/O to a
+   swap file without going through the file system. */
+block_sector_t
+inode_get_sector (const struct inode *inode, off_t pos)
+{
+  return byte_to_sector (inode, pos);
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
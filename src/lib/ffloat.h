@@ -4,6 +4,11 @@
 #include <debug.h>
 #include <stdint.h>
 
+/* Fixed-point real numbers with 14 fractional bits.
+
+   The operations are inline, since the scheduler uses them in
+   the timer interrupt. */
+
 #define __FRAC_BIT__ 16384 //2^14
 
 typedef struct
@@ -11,13 +16,52 @@ typedef struct
   int32_t __VAL__;
 } ffloat;
 
-ffloat f_div (ffloat a, ffloat b) CONST;
-ffloat f_mul (ffloat a, ffloat b) CONST;
-ffloat f_add (ffloat a, ffloat b) CONST;
-ffloat f_sub (ffloat a, ffloat b) CONST;
-ffloat f_round (ffloat a) CONST;
-
 #define FFLOAT(a)  ((ffloat) {(int32_t)(a) * __FRAC_BIT__})
 #define F_TOINT(a) (a.__VAL__ / __FRAC_BIT__)
 
+static inline ffloat
+f_div (ffloat a, ffloat b)
+{
+  ffloat temp;
+  temp.__VAL__ = ((int64_t) a.__VAL__) * __FRAC_BIT__ / b.__VAL__;
+  return temp;
+}
+
+static inline ffloat
+f_mul (ffloat a, ffloat b)
+{
+  ffloat temp;
+  temp.__VAL__ = ((int64_t) a.__VAL__) * b.__VAL__ / __FRAC_BIT__;
+  return temp;
+}
+
+static inline ffloat
+f_add (ffloat a, ffloat b)
+{
+  ffloat temp;
+  temp.__VAL__ = a.__VAL__ + b.__VAL__;
+  return temp;
+}
+
+static inline ffloat
+f_sub (ffloat a, ffloat b)
+{
+  ffloat temp;
+  temp.__VAL__ = a.__VAL__ - b.__VAL__;
+  return temp;
+}
+
+static inline ffloat
+f_round (ffloat a)
+{
+  ffloat temp;
+  if (a.__VAL__ > 0)
+    temp.__VAL__ = a.__VAL__ + (__FRAC_BIT__ / 2);
+  else
+    temp.__VAL__ = a.__VAL__ - (__FRAC_BIT__ / 2);
+
+  temp.__VAL__ = (temp.__VAL__ / __FRAC_BIT__) * __FRAC_BIT__;
+  return temp;
+}
+
 #endif /* lib/ffloat.h */
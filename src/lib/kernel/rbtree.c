@@ -0,0 +1,429 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree.
+
+   The implementation follows [CLRS] chapter 13, with null
+   pointers standing in for the black leaves:
+
+     1. Every element is either red or black.
+     2. The root is black.
+     3. A red element has no red children.
+     4. Every path from an element down to a null child passes
+        through the same number of black elements.
+
+   Together these keep the tree's height at most 2 lg (n + 1). */
+
+static bool is_red (const struct rb_elem *);
+static void replace_child (struct rbtree *, struct rb_elem *parent,
+                           struct rb_elem *old, struct rb_elem *new);
+static void rotate_left (struct rbtree *, struct rb_elem *);
+static void rotate_right (struct rbtree *, struct rb_elem *);
+static void insert_fixup (struct rbtree *, struct rb_elem *);
+static void remove_fixup (struct rbtree *, struct rb_elem *,
+                          struct rb_elem *parent);
+static struct rb_elem *leftmost (struct rb_elem *);
+static struct rb_elem *rightmost (struct rb_elem *);
+
+/* Initializes T as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rbtree *t, rb_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->elem_cnt = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rb_insert (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem *parent = NULL;
+  struct rb_elem **link = &t->root;
+
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      link = t->less (e, parent, t->aux) ? &parent->left : &parent->right;
+    }
+
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  t->elem_cnt++;
+
+  insert_fixup (t, e);
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem *child, *parent;
+  bool removed_red;
+
+  ASSERT (e != NULL);
+  ASSERT (t->elem_cnt > 0);
+
+  if (e->left == NULL || e->right == NULL)
+    {
+      /* E has at most one child, which takes its place. */
+      child = e->left != NULL ? e->left : e->right;
+      parent = e->parent;
+      removed_red = e->red;
+      if (child != NULL)
+        child->parent = parent;
+      replace_child (t, parent, e, child);
+    }
+  else
+    {
+      /* E's successor S, which has no left child, takes its
+         place and color, so the node really taken out of the
+         tree is at S's old position. */
+      struct rb_elem *s = leftmost (e->right);
+
+      child = s->right;
+      removed_red = s->red;
+      if (s->parent == e)
+        parent = s;
+      else
+        {
+          parent = s->parent;
+          if (child != NULL)
+            child->parent = parent;
+          parent->left = child;
+          s->right = e->right;
+          s->right->parent = s;
+        }
+      s->left = e->left;
+      s->left->parent = s;
+      s->parent = e->parent;
+      s->red = e->red;
+      replace_child (t, e->parent, e, s);
+    }
+  t->elem_cnt--;
+
+  if (!removed_red)
+    remove_fixup (t, child, parent);
+}
+
+/* Returns an element of T equal to KEY, or a null pointer if
+   there is none. */
+struct rb_elem *
+rb_find (const struct rbtree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+
+  while (e != NULL)
+    {
+      if (t->less (key, e, t->aux))
+        e = e->left;
+      else if (t->less (e, key, t->aux))
+        e = e->right;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Returns the greatest element of T that is less than or equal
+   to KEY, or a null pointer if there is none. */
+struct rb_elem *
+rb_floor (const struct rbtree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root, *best = NULL;
+
+  while (e != NULL)
+    {
+      if (t->less (key, e, t->aux))
+        e = e->left;
+      else
+        {
+          best = e;
+          e = e->right;
+        }
+    }
+  return best;
+}
+
+/* Returns the least element of T that is greater than or equal
+   to KEY, or a null pointer if there is none. */
+struct rb_elem *
+rb_ceil (const struct rbtree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root, *best = NULL;
+
+  while (e != NULL)
+    {
+      if (t->less (e, key, t->aux))
+        e = e->right;
+      else
+        {
+          best = e;
+          e = e->left;
+        }
+    }
+  return best;
+}
+
+/* Returns the least element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_min (const struct rbtree *t)
+{
+  return t->root != NULL ? leftmost (t->root) : NULL;
+}
+
+/* Returns the greatest element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_max (const struct rbtree *t)
+{
+  return t->root != NULL ? rightmost (t->root) : NULL;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the greatest. */
+struct rb_elem *
+rb_next (struct rb_elem *e)
+{
+  if (e->right != NULL)
+    return leftmost (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element that precedes E in its tree, or a null
+   pointer if E is the least. */
+struct rb_elem *
+rb_prev (struct rb_elem *e)
+{
+  if (e->left != NULL)
+    return rightmost (e->left);
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (const struct rbtree *t)
+{
+  return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+rb_empty (const struct rbtree *t)
+{
+  return t->elem_cnt == 0;
+}
+
+/* Returns true if E is red.  Null leaves are black. */
+static bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Makes NEW take the place of OLD as PARENT's child, or as T's
+   root if PARENT is null. */
+static void
+replace_child (struct rbtree *t, struct rb_elem *parent,
+               struct rb_elem *old, struct rb_elem *new)
+{
+  if (parent == NULL)
+    t->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+/* Rotates the subtree rooted at E to the left, so that its right
+   child takes its place. */
+static void
+rotate_left (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem *r = e->right;
+
+  e->right = r->left;
+  if (r->left != NULL)
+    r->left->parent = e;
+  r->parent = e->parent;
+  replace_child (t, e->parent, e, r);
+  r->left = e;
+  e->parent = r;
+}
+
+/* Rotates the subtree rooted at E to the right, so that its left
+   child takes its place. */
+static void
+rotate_right (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem *l = e->left;
+
+  e->left = l->right;
+  if (l->right != NULL)
+    l->right->parent = e;
+  l->parent = e->parent;
+  replace_child (t, e->parent, e, l);
+  l->right = e;
+  e->parent = l;
+}
+
+/* Restores the red-black properties after red element E was
+   inserted into T. */
+static void
+insert_fixup (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem *parent;
+
+  while ((parent = e->parent) != NULL && parent->red)
+    {
+      /* PARENT is red, so it is not the root. */
+      struct rb_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rb_elem *uncle = grandparent->right;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->right)
+            {
+              rotate_left (t, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (t, grandparent);
+        }
+      else
+        {
+          struct rb_elem *uncle = grandparent->left;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->left)
+            {
+              rotate_right (t, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (t, grandparent);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the red-black properties after a black element was
+   removed from T.  E, which may be null, is the element that
+   took its place, and PARENT is E's parent. */
+static void
+remove_fixup (struct rbtree *t, struct rb_elem *e, struct rb_elem *parent)
+{
+  while (e != t->root && !is_red (e))
+    {
+      /* E is one black short, so its sibling is not null. */
+      if (e == parent->left)
+        {
+          struct rb_elem *sibling = parent->right;
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->right))
+            {
+              sibling->left->red = false;
+              sibling->red = true;
+              rotate_right (t, sibling);
+              sibling = parent->right;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->right->red = false;
+          rotate_left (t, parent);
+        }
+      else
+        {
+          struct rb_elem *sibling = parent->left;
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->left))
+            {
+              sibling->right->red = false;
+              sibling->red = true;
+              rotate_left (t, sibling);
+              sibling = parent->left;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->left->red = false;
+          rotate_right (t, parent);
+        }
+      e = t->root;
+    }
+  if (e != NULL)
+    e->red = false;
+}
+
+/* Returns the least element of the subtree rooted at E. */
+static struct rb_elem *
+leftmost (struct rb_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the greatest element of the subtree rooted at E. */
+static struct rb_elem *
+rightmost (struct rb_elem *e)
+{
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
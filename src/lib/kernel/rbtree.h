@@ -0,0 +1,84 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree: insertion, removal and lookup
+   take O(log n) time, and the elements can be walked in order.
+
+   Like the linked list and the hash table, the tree does not
+   allocate memory.  Each structure that can be in a tree embeds
+   a struct rb_elem member, and rb_entry converts a struct
+   rb_elem back into the structure that contains it.  See
+   lib/kernel/list.h for a detailed explanation of the
+   technique.
+
+   Elements are ordered by a caller-supplied comparison
+   function.  Elements that compare equal are allowed; they are
+   kept in insertion order.
+
+   A tree of non-overlapping intervals ordered by their start
+   doubles as an interval tree: rb_floor() finds the only
+   interval that may contain a given point, and an interval
+   overlaps the tree if and only if the element rb_floor()
+   returns for its last point reaches into it. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or null for the root. */
+    struct rb_elem *left;       /* Left child, or null. */
+    struct rb_elem *right;      /* Right child, or null. */
+    bool red;                   /* Red or black? */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+   structure that RB_ELEM is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                       \
+        ((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent             \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rbtree
+  {
+    struct rb_elem *root;       /* Root, or null if empty. */
+    size_t elem_cnt;            /* Number of elements. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void rb_init (struct rbtree *, rb_less_func *, void *aux);
+
+/* Insertion and removal. */
+void rb_insert (struct rbtree *, struct rb_elem *);
+void rb_remove (struct rbtree *, struct rb_elem *);
+
+/* Search. */
+struct rb_elem *rb_find (const struct rbtree *, const struct rb_elem *);
+struct rb_elem *rb_floor (const struct rbtree *, const struct rb_elem *);
+struct rb_elem *rb_ceil (const struct rbtree *, const struct rb_elem *);
+
+/* Traversal, in ascending order. */
+struct rb_elem *rb_min (const struct rbtree *);
+struct rb_elem *rb_max (const struct rbtree *);
+struct rb_elem *rb_next (struct rb_elem *);
+struct rb_elem *rb_prev (struct rb_elem *);
+
+/* Information. */
+size_t rb_size (const struct rbtree *);
+bool rb_empty (const struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
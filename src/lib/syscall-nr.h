@@ -28,7 +28,31 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Duplicate the calling process. */
+    SYS_MSYNC,                  /* Write back a mapped range. */
+    SYS_MADVISE,                /* Advise on the use of a mapped range. */
+    SYS_SBRK,                   /* Grow or shrink the heap. */
+    SYS_MMAP_ANON,              /* Map zeroed memory. */
+    SYS_MUNMAP_ANON,            /* Remove a mapping of zeroed memory. */
+    SYS_MMAP_FLAGS              /* Map a file, with options. */
+  };
+
+/* Flags for mmap_flags(). */
+enum
+  {
+    MAP_POPULATE = 0x1          /* Read the whole mapping in now. */
+  };
+
+/* Advice for madvise(). */
+enum
+  {
+    MADV_NORMAL,                /* No special treatment. */
+    MADV_SEQUENTIAL,            /* Read ahead on page faults. */
+    MADV_WILLNEED,              /* Read the pages in now. */
+    MADV_DONTNEED               /* Drop the pages now. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,366 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A simple implementation of malloc() for user programs.
+
+   It works like the kernel's malloc() in threads/malloc.c.  The
+   size of each request, in bytes, is rounded up to a power of 2
+   and assigned to the "descriptor" that manages blocks of that
+   size.  The descriptor keeps a list of free blocks.  If the
+   free list is nonempty, one of its blocks is used to satisfy
+   the request.
+
+   Otherwise, a new page of memory, called an "arena", is carved
+   out of the heap, growing it with sbrk() if there is no free
+   page left in it.  The new arena is divided into blocks, all of
+   which are added to the descriptor's free list.  Then we return
+   one of the new blocks.
+
+   When we free a block, we add it to its descriptor's free list.
+   But if the arena that the block was in now has no in-use
+   blocks, we remove all of the arena's blocks from the free list
+   and give the page back: to the kernel, by shrinking the heap,
+   if it is the last page of the heap, or else to a list of free
+   pages for the next arena.
+
+   Blocks bigger than 2 kB do not fit in a page with an arena
+   header.  Each of those gets a mapping of its own from
+   mmap_anon(), with the page count stored in the arena header at
+   its start, and is unmapped again when freed.
+
+   User processes have a single thread, so there is no locking. */
+
+/* Size of a page. */
+#define PAGE_SIZE 4096
+
+/* Free block. */
+struct block
+  {
+    struct block *prev;         /* Previous free block. */
+    struct block *next;         /* Next free block. */
+  };
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct block *free_list;    /* First free block. */
+  };
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+  };
+
+/* Free page in the heap. */
+struct free_page
+  {
+    struct free_page *next;     /* Next free page. */
+  };
+
+/* Our set of descriptors. */
+static struct desc descs[8];    /* Descriptors. */
+static size_t desc_cnt;         /* Number of descriptors. */
+
+/* Free pages of the heap, most recently freed first. */
+static struct free_page *free_pages;
+
+static void init_descs (void);
+static struct arena *get_arena_page (void);
+static void free_arena_page (struct arena *);
+static void push_block (struct desc *, struct block *);
+static void remove_block (struct desc *, struct block *);
+static struct arena *block_to_arena (struct block *);
+static struct block *arena_to_block (struct arena *, size_t idx);
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+
+  if (desc_cnt == 0)
+    init_descs ();
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + desc_cnt)
+    {
+      /* SIZE is too big for any descriptor.
+         Map enough pages to hold SIZE plus an arena. */
+      size_t page_cnt;
+
+      if (size > SIZE_MAX - sizeof *a - PAGE_SIZE)
+        return NULL;
+      page_cnt = DIV_ROUND_UP (size + sizeof *a, PAGE_SIZE);
+      a = mmap_anon (NULL, page_cnt * PAGE_SIZE);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize the arena to indicate a big block of PAGE_CNT
+         pages, and return it. */
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return a + 1;
+    }
+
+  /* If the free list is empty, create a new arena. */
+  if (d->free_list == NULL)
+    {
+      size_t i;
+
+      a = get_arena_page ();
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = d->blocks_per_arena; i-- > 0; )
+        push_block (d, arena_to_block (a, i));
+    }
+
+  /* Get a block from free list and return it. */
+  b = d->free_list;
+  remove_block (d, b);
+  a = block_to_arena (b);
+  a->free_cnt--;
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  size = a * b;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block)
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  struct desc *d = a->desc;
+
+  return (d != NULL
+          ? d->block_size
+          : PAGE_SIZE * a->free_cnt - ((uintptr_t) block % PAGE_SIZE));
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block != NULL && new_size <= block_size (old_block))
+    return old_block;
+  else
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          size_t old_size = block_size (old_block);
+          size_t min_size = new_size < old_size ? new_size : old_size;
+          memcpy (new_block, old_block, min_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  if (p != NULL)
+    {
+      struct block *b = p;
+      struct arena *a = block_to_arena (b);
+      struct desc *d = a->desc;
+
+      if (d != NULL)
+        {
+          /* It's a normal block.  We handle it here. */
+
+#ifndef NDEBUG
+          /* Clear the block to help detect use-after-free bugs. */
+          memset (b, 0xcc, d->block_size);
+#endif
+
+          /* Add block to free list. */
+          push_block (d, b);
+
+          /* If the arena is now entirely unused, free it. */
+          if (++a->free_cnt >= d->blocks_per_arena)
+            {
+              size_t i;
+
+              ASSERT (a->free_cnt == d->blocks_per_arena);
+              for (i = 0; i < d->blocks_per_arena; i++)
+                remove_block (d, arena_to_block (a, i));
+              free_arena_page (a);
+            }
+        }
+      else
+        {
+          /* It's a big block.  Unmap its pages. */
+          munmap_anon (a);
+        }
+    }
+}
+
+/* Initializes the malloc() descriptors. */
+static void
+init_descs (void)
+{
+  size_t block_size;
+
+  for (block_size = 16; block_size < PAGE_SIZE / 2; block_size *= 2)
+    {
+      struct desc *d = &descs[desc_cnt++];
+      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      d->block_size = block_size;
+      d->blocks_per_arena = (PAGE_SIZE - sizeof (struct arena)) / block_size;
+      d->free_list = NULL;
+    }
+}
+
+/* Returns a page of the heap for a new arena, reusing a free one
+   if there is any, or a null pointer if the heap cannot grow. */
+static struct arena *
+get_arena_page (void)
+{
+  uint8_t *brk;
+
+  if (free_pages != NULL)
+    {
+      struct free_page *page = free_pages;
+      free_pages = page->next;
+      return (struct arena *) page;
+    }
+
+  /* The first time around, the break may not be page-aligned. */
+  brk = sbrk (0);
+  if ((uintptr_t) brk % PAGE_SIZE != 0
+      && sbrk (PAGE_SIZE - (uintptr_t) brk % PAGE_SIZE) == NULL)
+    return NULL;
+  return sbrk (PAGE_SIZE);
+}
+
+/* Returns arena page A to the heap: shrinks the heap if A is its
+   last page, otherwise keeps A for reuse. */
+static void
+free_arena_page (struct arena *a)
+{
+  struct free_page *page = (struct free_page *) a;
+
+  if ((uint8_t *) a + PAGE_SIZE == sbrk (0))
+    sbrk (-PAGE_SIZE);
+  else
+    {
+      page->next = free_pages;
+      free_pages = page;
+    }
+}
+
+/* Adds B to the front of D's free list. */
+static void
+push_block (struct desc *d, struct block *b)
+{
+  b->prev = NULL;
+  b->next = d->free_list;
+  if (b->next != NULL)
+    b->next->prev = b;
+  d->free_list = b;
+}
+
+/* Removes B from D's free list. */
+static void
+remove_block (struct desc *d, struct block *b)
+{
+  if (b->prev != NULL)
+    b->prev->next = b->next;
+  else
+    d->free_list = b->next;
+  if (b->next != NULL)
+    b->next->prev = b->prev;
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = (struct arena *) ((uintptr_t) b & ~(PAGE_SIZE - 1));
+
+  /* Check that the arena is valid. */
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || ((uintptr_t) b % PAGE_SIZE - sizeof *a)
+             % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || (uintptr_t) b % PAGE_SIZE == sizeof *a);
+
+  return a;
+}
+
+/* Returns the (IDX - 1)'th block within arena A. */
+static struct block *
+arena_to_block (struct arena *a, size_t idx)
+{
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (idx < a->desc->blocks_per_arena);
+  return (struct block *) ((uint8_t *) a
+                           + sizeof *a
+                           + idx * a->desc->block_size);
+}
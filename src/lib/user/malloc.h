@@ -0,0 +1,12 @@
+#ifndef __LIB_USER_MALLOC_H
+#define __LIB_USER_MALLOC_H
+
+#include <debug.h>
+#include <stddef.h>
+
+void free (void *);
+void *malloc (size_t) MALLOC(free);
+void *calloc (size_t, size_t) MALLOC(free);
+void *realloc (void *, size_t);
+
+#endif /* lib/user/malloc.h */
@@ -182,3 +182,45 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+bool
+msync (void *addr, unsigned length)
+{
+  return syscall2 (SYS_MSYNC, addr, length);
+}
+
+bool
+madvise (void *addr, unsigned length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+void *
+mmap_anon (void *addr, size_t length)
+{
+  return (void *) syscall2 (SYS_MMAP_ANON, addr, length);
+}
+
+void
+munmap_anon (void *addr)
+{
+  syscall1 (SYS_MUNMAP_ANON, addr);
+}
+
+mapid_t
+mmap_flags (int fd, void *addr, int flags)
+{
+  return syscall3 (SYS_MMAP_FLAGS, fd, addr, flags);
+}
@@ -2,7 +2,10 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <debug.h>
+#include "../syscall-nr.h"
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +48,13 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+pid_t fork (void);
+bool msync (void *addr, unsigned length);
+bool madvise (void *addr, unsigned length, int advice);
+void *sbrk (intptr_t increment);
+void *mmap_anon (void *addr, size_t length);
+void munmap_anon (void *addr);
+mapid_t mmap_flags (int fd, void *addr, int flags);
+
 #endif /* lib/user/syscall.h */
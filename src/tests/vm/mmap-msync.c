@@ -0,0 +1,40 @@
+/* Writes to a file through a mapping and writes it back with
+   msync() while it is still mapped, then reads the data in the
+   file back using the read system call to verify.  Finally drops
+   the mapped page with madvise() and checks that it reads back
+   from the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (msync (ACTUAL, strlen (sample)), "msync \"sample.txt\"");
+
+  /* Read back via read(), with the file still mapped. */
+  read (handle, buf, strlen (sample));
+  CHECK (!memcmp (buf, sample, strlen (sample)),
+         "compare read data against written data");
+
+  /* Drop the page and fault it back in from the file. */
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_DONTNEED),
+         "madvise \"sample.txt\"");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)),
+         "compare mapped data against written data");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync) begin
+(mmap-msync) create "sample.txt"
+(mmap-msync) open "sample.txt"
+(mmap-msync) mmap "sample.txt"
+(mmap-msync) msync "sample.txt"
+(mmap-msync) compare read data against written data
+(mmap-msync) madvise "sample.txt"
+(mmap-msync) compare mapped data against written data
+(mmap-msync) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Forks with a 64 kB buffer in memory and has the child
+   overwrite its copy.  The parent's copy must be left alone,
+   since pages are only shared until one side writes to them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/cksum.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  unsigned long before;
+  pid_t pid;
+
+  memset (buf, 0x5a, sizeof buf);
+  before = cksum (buf, sizeof buf);
+
+  msg ("fork");
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Child. */
+      if (cksum (buf, sizeof buf) != before)
+        fail ("child sees different data after fork");
+      memset (buf, 0xa5, sizeof buf);
+      if (buf[0] != (char) 0xa5 || buf[SIZE - 1] != (char) 0xa5)
+        fail ("child cannot write its copy");
+      exit (81);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+  CHECK (wait (pid) == 81, "wait for child");
+  if (cksum (buf, sizeof buf) != before)
+    fail ("child's writes are visible to the parent");
+  msg ("parent's copy is intact");
+}
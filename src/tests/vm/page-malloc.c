@@ -0,0 +1,56 @@
+/* Allocates blocks of many sizes from the heap with malloc(),
+   fills each one with its own pattern, and checks that none of
+   them was overwritten before freeing them.  Then does the same
+   with a block big enough to get a mapping of its own, and
+   checks that the heap grows and shrinks with sbrk(). */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 256
+#define BIG_SIZE (256 * 1024)
+
+static size_t
+block_size (int i)
+{
+  return 1 + (i * 37) % 2000;
+}
+
+void
+test_main (void)
+{
+  char *blocks[BLOCK_CNT];
+  char *big, *brk;
+  int i;
+  size_t j;
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      blocks[i] = malloc (block_size (i));
+      if (blocks[i] == NULL)
+        fail ("malloc of block %d failed", i);
+      memset (blocks[i], i, block_size (i));
+    }
+  for (i = 0; i < BLOCK_CNT; i++)
+    for (j = 0; j < block_size (i); j++)
+      if (blocks[i][j] != (char) i)
+        fail ("block %d byte %zu is %d", i, j, blocks[i][j]);
+  for (i = 0; i < BLOCK_CNT; i++)
+    free (blocks[i]);
+  msg ("small blocks intact");
+
+  CHECK ((big = malloc (BIG_SIZE)) != NULL, "malloc big block");
+  memset (big, 0x5a, BIG_SIZE);
+  for (j = 0; j < BIG_SIZE; j++)
+    if (big[j] != 0x5a)
+      fail ("big block byte %zu is %d", j, big[j]);
+  free (big);
+
+  brk = sbrk (0);
+  CHECK (sbrk (4096) == brk, "grow heap");
+  memset (brk, 0xcc, 4096);
+  CHECK (sbrk (-4096) == brk + 4096, "shrink heap");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-malloc) begin
+(page-malloc) small blocks intact
+(page-malloc) malloc big block
+(page-malloc) grow heap
+(page-malloc) shrink heap
+(page-malloc) end
+EOF
+pass;
@@ -39,9 +39,19 @@
 #include "filesys/fsutil.h"
 #endif
 #ifdef VM
+#include "vm/ksm.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/pageout.h"
+#include "vm/pcache.h"
 #include "vm/swap-alloc.h"
 #endif
 
+/* CR4 bit that enables global pages, and the CPUID feature bit
+   (in EDX of leaf 1) that says the CPU has it. */
+#define CR4_PGE 0x00000080
+#define CPUID_PGE 0x00002000
+
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
@@ -49,12 +59,27 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
-/* -filesys, -scratch, -swap: Names of block devices to use,
-   overriding the defaults. */
+/* -filesys, -scratch: Names of block devices to use, overriding
+   the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
 #ifdef VM
-static const char *swap_bdev_name;
+/* -swap: Comma-separated swap devices, each with an optional
+   ":PRIO", to use instead of all the swap partitions. */
+static char *swap_bdev_names;
+
+/* -swapfile: Swap file, as "NAME:PAGES[:PRIO]". */
+static char *swap_file_spec;
+
+/* -wml, -wmh: Free user frames below which the page-out daemon
+   wakes up, and up to which it evicts.  Zero selects a default. */
+static size_t pageout_low;
+static size_t pageout_high;
+
+/* -ksm, -ksms: Frames the same-page merging thread examines per
+   batch, zero to not run it, and milliseconds between batches. */
+static size_t ksm_scan_cnt;
+static unsigned ksm_sleep_ms = 20;
 #endif
 #endif /* FILESYS */
 
@@ -63,6 +88,7 @@ static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_pge (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -72,6 +98,12 @@ static void usage (void);
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+#ifdef VM
+static void locate_swap_devices (void);
+static void use_swap_device (struct block *, int prio);
+static void locate_swap_file (void);
+static void set_stack_limit (const char *);
+#endif
 #endif
 
 int main (void) NO_RETURN;
@@ -131,7 +163,15 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #ifdef VM
+  if (swap_file_spec != NULL)
+    locate_swap_file ();
   swap_init ();
+  pcache_init ();
+  page_init ();
+  if (swap_available ())
+    pageout_init (pageout_low, pageout_high);
+  if (ksm_scan_cnt > 0)
+    ksm_init (ksm_scan_cnt, ksm_sleep_ms);
 #endif /* VM */
 #endif /* FILESYS */
 
@@ -194,6 +234,31 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Honor the global bit of kernel PTEs, if the CPU supports it,
+     so that kernel TLB entries are not flushed when a process
+     switch reloads CR3.  See [IA32-v3a] 3.12 "Translation
+     Lookaside Buffers (TLBs)". */
+  if (cpu_has_pge ())
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE) : "memory");
+    }
+}
+
+/* Returns true if the CPU supports global pages, according to
+   CPUID.  See [IA32-v2a] "CPUID--CPU Identification". */
+static bool
+cpu_has_pge (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0));
+  if (eax < 1)
+    return false;
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  return (edx & CPUID_PGE) != 0;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -257,16 +322,42 @@ parse_options (char **argv)
         scratch_bdev_name = value;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
-        swap_bdev_name = value;
+        swap_bdev_names = value;
+      else if (!strcmp (name, "-swapfile"))
+        swap_file_spec = value;
+      else if (!strcmp (name, "-wml"))
+        pageout_low = atoi (value);
+      else if (!strcmp (name, "-wmh"))
+        pageout_high = atoi (value);
+      else if (!strcmp (name, "-prefault"))
+        mmap_prefault_exec = true;
+      else if (!strcmp (name, "-ksm"))
+        ksm_scan_cnt = atoi (value);
+      else if (!strcmp (name, "-ksms"))
+        ksm_sleep_ms = atoi (value);
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
-        thread_mlfqs = true;
+        {
+          thread_mlfqs = true;
+          thread_cfs = false;
+        }
+      else if (!strcmp (name, "-cfs"))
+        {
+          thread_cfs = true;
+          thread_mlfqs = false;
+        }
+      else if (!strcmp (name, "-nohz"))
+        timer_tickless = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#ifdef VM
+      else if (!strcmp (name, "-sl"))
+        set_stack_limit (value);
+#endif
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -382,13 +473,26 @@ usage (void)
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV[:PRIO],...\n"
+          "                     Swap to BDEVs instead of all swap partitions.\n"
+          "  -swapfile=FILE:PAGES[:PRIO]\n"
+          "                     Also swap to FILE, creating it with PAGES pages.\n"
+          "  -wml=COUNT         Start paging out below COUNT free frames.\n"
+          "  -wmh=COUNT         Page out until COUNT frames are free.\n"
+          "  -prefault          Read executables in completely on exec.\n"
+          "  -ksm=COUNT         Merge identical pages, COUNT frames a batch.\n"
+          "  -ksms=MS           Sleep MS milliseconds between merge batches.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -cfs               Use completely fair scheduler.\n"
+          "  -nohz              Stop the timer tick while the CPU is idle.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#ifdef VM
+          "  -sl=COUNT          Limit each process's stack to COUNT pages.\n"
+#endif
 #endif
           );
   shutdown_power_off ();
@@ -402,7 +506,7 @@ locate_block_devices (void)
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
 #ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
+  locate_swap_devices ();
 #endif
 }
 
@@ -434,4 +538,81 @@ locate_block_device (enum block_type role, const char *name)
       block_set_role (role, block);
     }
 }
+
+#ifdef VM
+/* Adds the block devices named by -swap to swap, or else every
+   swap partition, all at priority 0 unless given.  Swap is
+   spread evenly over several devices at the same priority. */
+static void
+locate_swap_devices (void)
+{
+  struct block *block;
+
+  if (swap_bdev_names != NULL)
+    {
+      char *name, *save_ptr;
+
+      for (name = strtok_r (swap_bdev_names, ",", &save_ptr); name != NULL;
+           name = strtok_r (NULL, ",", &save_ptr))
+        {
+          char *prio = strchr (name, ':');
+
+          if (prio != NULL)
+            *prio++ = '\0';
+          block = block_get_by_name (name);
+          if (block == NULL)
+            PANIC ("No such block device \"%s\"", name);
+          use_swap_device (block, prio != NULL ? atoi (prio) : 0);
+        }
+    }
+  else
+    {
+      for (block = block_first (); block != NULL; block = block_next (block))
+        if (block_type (block) == BLOCK_SWAP)
+          use_swap_device (block, 0);
+    }
+}
+
+/* Swaps to BLOCK at priority PRIO.  The first swap device also
+   takes the swap role. */
+static void
+use_swap_device (struct block *block, int prio)
+{
+  printf ("%s: using %s\n", block_type_name (BLOCK_SWAP), block_name (block));
+  if (block_get_role (BLOCK_SWAP) == NULL)
+    block_set_role (BLOCK_SWAP, block);
+  swap_add_device (block, prio);
+}
+
+/* Sets the stack limit of user processes to the number of pages
+   in VALUE, given with -sl.  The limit and the guard gap below it
+   must leave room for the executable. */
+static void
+set_stack_limit (const char *value)
+{
+  size_t max_pages = ((uintptr_t) PHYS_BASE - (uintptr_t) EXEC_BASE
+                      - STACK_GUARD_SIZE) / PGSIZE;
+  int pages = atoi (value);
+
+  /* atoi() does not check for overflow, so reject numbers with
+     more digits than any valid COUNT before trusting it. */
+  if (strlen (value) > 9 || pages < 1 || (size_t) pages > max_pages)
+    PANIC ("-sl=COUNT needs a COUNT from 1 to %zu", max_pages);
+  process_stack_limit = (size_t) pages * PGSIZE;
+}
+
+/* Adds the swap file given by -swapfile to swap. */
+static void
+locate_swap_file (void)
+{
+  char *save_ptr;
+  char *name = strtok_r (swap_file_spec, ":", &save_ptr);
+  char *pages = strtok_r (NULL, ":", &save_ptr);
+  char *prio = strtok_r (NULL, ":", &save_ptr);
+
+  if (name == NULL || pages == NULL)
+    PANIC ("-swapfile needs NAME:PAGES");
+  swap_add_file (name, atoi (pages), prio != NULL ? atoi (prio) : 0);
+}
+#endif
 #endif
@@ -185,6 +185,20 @@ intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Returns true if external interrupt VEC_NO has been raised but
+   not yet delivered, as when interrupts are off. */
+bool
+intr_ext_pending (uint8_t vec_no)
+{
+  int ctrl = vec_no < 0x28 ? PIC0_CTRL : PIC1_CTRL;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  /* OCW3: read the interrupt request register. */
+  outb (ctrl, 0x0a);
+  return (inb (ctrl) & (1 << (vec_no & 7))) != 0;
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The interrupt handler
    will be invoked with interrupt status LEVEL.
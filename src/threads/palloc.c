@@ -12,9 +12,8 @@
 #include "threads/vaddr.h"
 
 #ifdef VM
-#include "threads/thread.h"
-#include "threads/interrupt.h"
-#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/pageout.h"
 #endif /* VM */
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -37,6 +36,7 @@ struct pool
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t free_cnt;                    /* Number of free pages. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -46,22 +46,6 @@ static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
 
-#ifdef VM
-static thread_action_func evict_page;
-
-static void
-evict_page (struct thread *t, void *_cur)
-{
-  if ((void *)t == _cur)
-    return;
-
-  pagedir_evict_page (t->pagedir, t->stack);
-
-  /* pagedir operations mess up the pagedir*/
-  pagedir_activate (t->pagedir);
-}
-#endif /* VM */
-
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
 void
@@ -81,6 +65,9 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+#ifdef VM
+  frame_init (user_pool.base, bitmap_size (user_pool.used_map));
+#endif /* VM */
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -101,29 +88,25 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
   lock_acquire (&pool->lock);
   page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  if (page_idx != BITMAP_ERROR)
+    pool->free_cnt -= page_cnt;
   lock_release (&pool->lock);
 
 #ifdef VM
-  struct thread *t = thread_current ();
-
-  if (page_idx == BITMAP_ERROR)
+  /* Out of user frames: evict until enough are free. */
+  while (page_idx == BITMAP_ERROR && pool == &user_pool && frame_evict ())
     {
-      pagedir_evict_page (t->pagedir, t->esp ? ((void *)t-> esp) : ((void *)STACK_BASE));
-
       lock_acquire (&pool->lock);
       page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      if (page_idx != BITMAP_ERROR)
+        pool->free_cnt -= page_cnt;
       lock_release (&pool->lock);
     }
-  if (page_idx == BITMAP_ERROR)
-    {
-      enum intr_level old_level = intr_disable ();
-      thread_foreach (evict_page, (void *) t);
-      intr_set_level (old_level);
 
-      lock_acquire (&pool->lock);
-      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-      lock_release (&pool->lock);
-    }
+  /* Running low: let the page-out daemon free frames ahead of
+     the next fault. */
+  if (pool == &user_pool)
+    pageout_wake ();
 #endif
 
   if (page_idx != BITMAP_ERROR)
@@ -138,7 +121,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
     }
   else 
     {
-      //TODO //if (flags & PAL_ASSERT)
+      if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
     }
 
@@ -182,8 +165,21 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+#ifdef VM
+  if (pool == &user_pool)
+    for (size_t i = 0; i < page_cnt; i++)
+      frame_clear ((uint8_t *) pages + i * PGSIZE);
+#endif /* VM */
+
+  /* Kernel pages are freed by the scheduler itself, which must
+     not block, so only user pages are freed under the lock. */
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  if (pool == &user_pool)
+    lock_acquire (&pool->lock);
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool->free_cnt += page_cnt;
+  if (pool == &user_pool)
+    lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -193,6 +189,13 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free (void)
+{
+  return user_pool.free_cnt;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -212,6 +215,7 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   lock_init (&p->lock);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+  p->free_cnt = page_cnt;
 }
 
 /* Returns true if PAGE was allocated from POOL,
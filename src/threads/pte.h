@@ -61,15 +61,12 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_FLAGS 0x00000fff    /* Flag bits. */
 #define PTE_ADDR  0xfffff000    /* Address bits. */
 #define PTE_AVL   0x00000e00    /* Bits available for OS use. */
-#define PTE_SWAP  0x00000200    /* SWAP */
-#define PTE_SHARE 0x00000400    /* Shared memory */
-#define PTE_MMAP  0x00000600    /* Memory mapped file, not loaded */
-#define PTE_BLANK 0x00000800    /* Memory filled with zero, not loaded */
 #define PTE_P 0x1               /* 1=present, 0=not present. */
 #define PTE_W 0x2               /* 1=read/write, 0=read-only. */
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_G 0x100             /* 1=global, kept across CR3 loads. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -87,10 +84,13 @@ static inline uint32_t *pde_get_pt (uint32_t pde) {
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
-   The page will be usable only by ring 0 code (the kernel). */
+   The page will be usable only by ring 0 code (the kernel).
+   Kernel mappings are the same in every page directory, so they
+   are global: with CR4.PGE set, their TLB entries survive the
+   CR3 reload of a process switch. */
 static inline uint32_t pte_create_kernel (void *page, bool writable) {
   ASSERT (pg_ofs (page) == 0);
-  return vtop (page) | PTE_P | (writable ? PTE_W : 0);
+  return vtop (page) | PTE_P | PTE_G | (writable ? PTE_W : 0);
 }
 
 /* Returns a PTE that points to PAGE.
@@ -98,49 +98,8 @@ static inline uint32_t pte_create_kernel (void *page, bool writable) {
    If WRITABLE is true then it will be writable as well.
    The page will be usable by both user and kernel code. */
 static inline uint32_t pte_create_user (void *page, bool writable) {
-  return pte_create_kernel (page, writable) | PTE_U;
-}
-
-static inline uint32_t pte_set_as_swap (uint32_t pte, size_t swap_idx) {
-  ASSERT ((swap_idx << 12) >> 12 == swap_idx);
-  return (swap_idx << 12) | ((pte & ~PTE_ADDR & ~PTE_P & ~PTE_AVL) | PTE_SWAP);
-}
-
-static inline uint32_t pte_create_mmap (int mid) {
-  return (mid << 12) | PTE_U | PTE_W | PTE_MMAP;
-}
-
-static inline uint32_t pte_create_blank (bool writable) {
-  return PTE_U | (writable ? PTE_W : 0) | PTE_BLANK;
-}
-
-static inline uint32_t pte_set_as_page (uint32_t pte, void *page) {
-  ASSERT ((pte & PTE_AVL) != 0);
-  return vtop (page) | PTE_P | ((pte & ~PTE_ADDR) & ~PTE_AVL);
-}
-
-static inline size_t pte_get_swap_idx (uint32_t pte) {
-  return (pte & PTE_ADDR) >> 12;
-}
-
-static inline bool pte_is_swapped (uint32_t pte) {
-  return (pte & PTE_AVL) == PTE_SWAP;
-}
-
-static inline bool pte_is_mmapped (uint32_t pte) {
-  return (pte & PTE_AVL) == PTE_MMAP;
-}
-
-static inline bool pte_is_blank (uint32_t pte) {
-  return (pte & PTE_AVL) == PTE_BLANK;
-}
-
-static inline bool pte_is_used (uint32_t pte) {
-  return (pte & PTE_AVL) || (pte & PTE_P);
-}
-
-static inline bool pte_is_user (uint32_t pte) {
-  return (pte & PTE_U) == PTE_U;
+  ASSERT (pg_ofs (page) == 0);
+  return vtop (page) | PTE_P | PTE_U | (writable ? PTE_W : 0);
 }
 
 /* Returns a pointer to the page that page table entry PTE points
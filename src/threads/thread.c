@@ -17,6 +17,9 @@
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef VM
+#include "vm/mmap.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -27,9 +30,18 @@
    that are ready to run but not actually running. */
 static struct list ready_list [PRI_MAX + 1];
 
-/* List of processes sleeping.
-   Semaphores have their own queues.*/
-static struct list sleep_list;
+/* Processes sleeping in thread_wakemeupat(), ordered by wakeup
+   time, and the earliest wakeup time, or INT64_MAX if there are
+   none.  The timer interrupt checks the latter once per tick.
+   Semaphores have their own queues. */
+static struct rbtree sleep_tree;
+static int64_t next_wakeup;
+
+/* Likewise for processes sleeping in thread_sleep_ns(), by
+   deadline in nanoseconds.  The timer interrupts at the earliest
+   deadline if it comes before the next tick. */
+static struct rbtree deadline_tree;
+static int64_t next_deadline;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -55,10 +67,86 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* TODO */
+/* Multi-level feedback queue scheduler state.  LOAD_AVG is the
+   system load average, and READY_THREADS the number of threads
+   running or ready to run, other than the idle thread. */
 static ffloat load_avg;
 static int    ready_threads;
 
+/* Lazy decay of recent_cpu.
+
+   Once a second, every thread's recent_cpu decays by a factor
+   that depends on the load average.  Instead of visiting every
+   thread then, the timer interrupt only starts a new epoch and
+   records its factor.  A thread's recent_cpu is brought up to
+   date, and its priority recomputed, when the thread is next
+   examined: when it is unblocked or yields, once per epoch if it
+   is ready, and at every priority update if it is running.  Only
+   the running thread's recent_cpu grows, so nobody else's
+   priority changes in between.
+
+   Ready threads are brought up to date a few at a time.  Each
+   call to next_thread_to_run() moves up to REQUEUE_BATCH of them
+   to the ready lists for their new priorities, working down from
+   PRI_MAX.  Threads are only ever added at the back of a ready
+   list, up to date, so the ones behind form a prefix of each
+   list.  With N threads ready, their priorities therefore catch
+   up with a new epoch within N / REQUEUE_BATCH thread switches,
+   and no switch does more than a constant amount of the work.
+
+   The last DECAY_HISTORY factors are kept.  A thread blocked for
+   longer has the oldest known factor applied for the seconds
+   before, up to DECAY_HISTORY of them. */
+#define DECAY_HISTORY 64
+static unsigned decay_epoch;            /* Seconds of decay so far. */
+static ffloat decay_factors[DECAY_HISTORY]; /* Factor of each epoch. */
+#define REQUEUE_BATCH 8
+static unsigned requeue_epoch;          /* Epoch being requeued for. */
+static int requeue_pri;                 /* Ready list to requeue next. */
+
+/* Completely fair scheduler.
+
+   With -cfs, priorities do not decide who runs.  Each thread
+   accumulates virtual runtime instead: the nanoseconds it has
+   run, scaled by NICE_0_WEIGHT over its weight.  The weight
+   grows by about 25% for each step of `nice' below 0 and shrinks
+   likewise above, so that a thread's share of the CPU changes by
+   about 10% per step.  Ready threads are kept in CFS_TREE ordered
+   by virtual runtime, and the one that has had the least runs
+   next.
+
+   The running thread is preempted at a tick once it has run for
+   its weight's share of CFS_LATENCY, or CFS_MIN_GRAN if that is
+   more.  Otherwise a thread switch happens only if a ready thread
+   has run less than the running thread by more than CFS_MIN_GRAN
+   of its own virtual time, so that threads that wake up often do
+   not switch for every small difference.
+
+   MIN_VRUNTIME follows the least virtual runtime of the runnable
+   threads and never goes back.  A thread that blocked is placed
+   at most CFS_LATENCY / 2 behind it when it wakes up, so sleeping
+   does not earn an unbounded claim on the CPU. */
+#define NICE_0_WEIGHT 1024
+#define CFS_LATENCY (40 * 1000 * 1000)  /* Period to share, in ns. */
+#define CFS_MIN_GRAN (10 * 1000 * 1000) /* Least slice, in ns. */
+static struct rbtree cfs_tree;          /* Ready threads by vruntime. */
+static int64_t cfs_tree_weight;         /* Total weight in cfs_tree. */
+static int64_t min_vruntime;            /* Least runnable vruntime. */
+static int64_t cfs_exec_start;          /* When vruntime was charged. */
+static int64_t cfs_slice_start;         /* When the slice started. */
+static bool cfs_resched;                /* Slice is used up. */
+
+/* Weight for each nice value from -20 to 20. */
+static const int nice_weights[41] =
+  {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705,
+    14949, 11916,  9548,  7620,  6100,  4904,  3906,  3121,
+     2501,  1991,  1586,  1277,  1024,   820,   655,   526,
+      423,   335,   272,   215,   172,   137,   110,    87,
+       70,    56,    45,    36,    29,    23,    18,    15,
+       12,
+  };
+
 /* Statistics. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
@@ -73,11 +161,22 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler instead.
+   Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
 static void kernel_thread (thread_func *, void *aux);
 
-static void decay_recent_cpu (struct thread *t, ffloat *decay_factor);
-static void update_pri (struct thread *t, void *none UNUSED);
-static bool update_recent_cpu (void);
+static void mlfqs_update (struct thread *);
+static void mlfqs_requeue_some (void);
+static bool update_recent_cpu (struct thread *);
+static void account_tick (struct thread *);
+
+static int cfs_weight (const struct thread *);
+static void cfs_charge (void);
+static bool cfs_lags (const struct thread *);
+static bool cfs_slice_expired (void);
+static rb_less_func vruntime_less;
 
 static void set_pri (struct thread *t, int new_priority);
 static int  get_pri (struct thread *t);
@@ -85,7 +184,10 @@ static int  get_pri (struct thread *t);
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
-static void thread_wakeup_sleepers (void);
+static void ready_push (struct thread *);
+static bool thread_wakeup_sleepers (int64_t now);
+static bool wake_expired (struct rbtree *, int64_t *next, int64_t now);
+static rb_less_func wakeup_less;
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -120,7 +222,11 @@ thread_init (void)
   for (int i=PRI_MIN;i<=PRI_MAX;i++)
     list_init (&ready_list[i]);
   list_init (&all_list);
-  list_init (&sleep_list);
+  rb_init (&sleep_tree, wakeup_less, NULL);
+  next_wakeup = INT64_MAX;
+  rb_init (&deadline_tree, wakeup_less, NULL);
+  next_deadline = INT64_MAX;
+  rb_init (&cfs_tree, vruntime_less, NULL);
 
   /* Set up a thread structure for the running thread. */
   ready_threads = 1;
@@ -150,61 +256,173 @@ thread_start (void)
   ready_threads--;
 }
 
+/* Brings T's recent_cpu up to the current epoch and recomputes
+   its priority.  T must not be on a ready list. */
 static void
-decay_recent_cpu (struct thread *t, ffloat *decay_factor)
+mlfqs_update (struct thread *t)
 {
-  t->recent_cpu = f_add (f_mul (*decay_factor, t->recent_cpu), FFLOAT (t->nice));
-}
+  unsigned missed = decay_epoch - t->decay_epoch;
+  int pri;
 
-static void
-update_pri (struct thread *t, void *none UNUSED)
-{
-  ASSERT (is_thread (t));
   ASSERT (thread_mlfqs);
-
   if (t == idle_thread)
     {
-      t->priority = 0;
+      t->priority = PRI_MIN;
       return;
     }
 
-  int old_pri = t->priority;
-  int new_pri = PRI_MAX - (F_TOINT (t->recent_cpu) / 4) - (t->nice * 2);
-  new_pri = CLAMP (new_pri, PRI_MIN, PRI_MAX);
+  /* Decay once for each epoch missed, oldest first. */
+  if (missed > 2 * DECAY_HISTORY)
+    missed = 2 * DECAY_HISTORY;
+  for (; missed > 0; missed--)
+    {
+      unsigned epoch = (missed <= DECAY_HISTORY
+                        ? decay_epoch - missed + 1
+                        : decay_epoch - DECAY_HISTORY + 1);
+      t->recent_cpu = f_add (f_mul (decay_factors[epoch % DECAY_HISTORY],
+                                    t->recent_cpu),
+                             FFLOAT (t->nice));
+    }
+  t->decay_epoch = decay_epoch;
+
+  pri = PRI_MAX - (F_TOINT (t->recent_cpu) / 4) - (t->nice * 2);
+  t->priority = CLAMP (pri, PRI_MIN, PRI_MAX);
+}
 
-  t->priority = new_pri;
-  if (old_pri != new_pri && t->status == THREAD_READY)
+/* Brings up to REQUEUE_BATCH ready threads up to the current
+   epoch, moving them to the ready lists for their new
+   priorities. */
+static void
+mlfqs_requeue_some (void)
+{
+  int budget = REQUEUE_BATCH;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (requeue_epoch != decay_epoch)
     {
-      list_remove (&t->elem);
-      list_push_back (&ready_list[new_pri], &t->elem);
+      requeue_epoch = decay_epoch;
+      requeue_pri = PRI_MAX;
+    }
+
+  while (budget > 0 && requeue_pri >= PRI_MIN)
+    {
+      struct list *list = &ready_list[requeue_pri];
+      struct thread *t;
+
+      t = (list_empty (list) ? NULL
+           : list_entry (list_front (list), struct thread, elem));
+      if (t == NULL || t->decay_epoch == decay_epoch)
+        {
+          requeue_pri--;
+          continue;
+        }
+      list_pop_front (list);
+      mlfqs_update (t);
+      list_push_back (&ready_list[t->priority], &t->elem);
+      budget--;
     }
 }
 
+/* Charges the timer tick to T for the multi-level feedback queue
+   scheduler, starting a new decay epoch once a second.  Returns
+   true if priorities were due for an update, in which case the
+   running thread should yield. */
 static bool
-update_recent_cpu ()
+update_recent_cpu (struct thread *t)
 {
-  ffloat decay_factor;
   int64_t time = timer_ticks ();
-  struct thread *t = thread_current ();
 
-  t->recent_cpu = f_add (t->recent_cpu, FFLOAT (1));
-
-  bool   update_priority = (time % 4 == 0);
-  if (update_priority)
-    thread_foreach ((thread_action_func *) update_pri, NULL);
+  if (t != idle_thread)
+    t->recent_cpu = f_add (t->recent_cpu, FFLOAT (1));
 
   if (time % TIMER_FREQ == 0)
     {
-      decay_factor = f_div (load_avg,
-                            f_add (load_avg, f_div (FFLOAT (1), FFLOAT (2))));
-        load_avg     = f_div
-                         (f_add (f_mul (FFLOAT (59), load_avg),
-                                 FFLOAT (ready_threads)),
-                          FFLOAT (60));
-      thread_foreach ((thread_action_func *) decay_recent_cpu, &decay_factor);
+      ffloat decay_factor
+        = f_div (load_avg, f_add (load_avg, f_div (FFLOAT (1), FFLOAT (2))));
+      load_avg = f_div (f_add (f_mul (FFLOAT (59), load_avg),
+                               FFLOAT (ready_threads)),
+                        FFLOAT (60));
+      decay_factors[++decay_epoch % DECAY_HISTORY] = decay_factor;
+    }
+
+  if (time % 4 != 0)
+    return false;
+  mlfqs_update (thread_current ());
+  return true;
+}
+
+/* Returns T's weight for the completely fair scheduler. */
+static int
+cfs_weight (const struct thread *t)
+{
+  ASSERT_CLAMP (t->nice, -20, 20);
+  return nice_weights[t->nice + 20];
+}
+
+/* Charges the running thread for the time it has run since it
+   was last charged, and advances min_vruntime. */
+static void
+cfs_charge (void)
+{
+  struct thread *cur = running_thread ();
+  struct rb_elem *e = rb_min (&cfs_tree);
+  int64_t now = timer_now_ns ();
+  int64_t least = min_vruntime;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (cur != idle_thread)
+    {
+      cur->vruntime += ((now - cfs_exec_start) * NICE_0_WEIGHT
+                        / cfs_weight (cur));
+      least = cur->vruntime;
     }
+  if (e != NULL)
+    {
+      int64_t v = rb_entry (e, struct thread, run_elem)->vruntime;
+      least = cur != idle_thread ? MIN (least, v) : v;
+    }
+  min_vruntime = MAX (min_vruntime, least);
+  cfs_exec_start = now;
+}
 
-  return update_priority;
+/* Returns true if ready thread T has run less than the running
+   thread by more than the minimum granularity, measured in T's
+   virtual time, so that it should take over the CPU.  The
+   running thread must have been charged. */
+static bool
+cfs_lags (const struct thread *t)
+{
+  struct thread *cur = running_thread ();
+
+  if (cur == idle_thread)
+    return true;
+  return (cur->vruntime - t->vruntime
+          > (int64_t) CFS_MIN_GRAN * NICE_0_WEIGHT / cfs_weight (t));
+}
+
+/* Charges the running thread at a timer tick.  Returns true if
+   it has used up its slice and another thread is ready, in which
+   case it should yield. */
+static bool
+cfs_slice_expired (void)
+{
+  struct thread *cur = thread_current ();
+  int64_t slice;
+
+  cfs_charge ();
+  if (rb_empty (&cfs_tree))
+    return false;
+  if (cur == idle_thread)
+    return true;
+
+  slice = (int64_t) CFS_LATENCY * cfs_weight (cur)
+          / (cfs_tree_weight + cfs_weight (cur));
+  if (cfs_exec_start - cfs_slice_start < MAX (slice, CFS_MIN_GRAN))
+    return false;
+  cfs_resched = true;
+  return true;
 }
 
 /* Called by the timer interrupt handler at each timer tick.
@@ -212,8 +430,22 @@ update_recent_cpu ()
 void
 thread_tick (void)
 {
-  struct thread *t = thread_current ();
+  account_tick (thread_current ());
+}
 
+/* Called by the timer interrupt handler for each tick that went
+   by while the timer tick was stopped and the CPU idle. */
+void
+thread_tick_idle (void)
+{
+  account_tick (idle_thread);
+}
+
+/* Charges a timer tick to T, which is the running thread or the
+   idle thread, and does the scheduling work due at the tick. */
+static void
+account_tick (struct thread *t)
+{
   /* Update statistics. */
   if (t == idle_thread)
     idle_ticks++;
@@ -225,11 +457,16 @@ thread_tick (void)
     kernel_ticks++;
 
   if (thread_mlfqs)
-    if (update_recent_cpu ())
+    if (update_recent_cpu (t))
       intr_yield_on_return ();
 
+  if (thread_wakeup_sleepers (timer_ticks ()))
+    intr_yield_on_return ();
+
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (t != thread_current ())
+    return;
+  if (thread_cfs ? cfs_slice_expired () : ++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
@@ -352,8 +589,13 @@ thread_unblock (struct thread *t)
   ASSERT_CLAMP (t->priority, PRI_MIN, PRI_MAX);
   if (t != idle_thread)
     {
-      list_push_back (&ready_list[get_pri (t)], &t->elem);
+      if (thread_mlfqs)
+        mlfqs_update (t);
+      else if (thread_cfs)
+        t->vruntime = MAX (t->vruntime, min_vruntime - CFS_LATENCY / 2);
+      ready_push (t);
       ready_threads++;
+      timer_tick_resume ();
     }
   t->status = THREAD_READY;
   intr_set_level (old_level);
@@ -362,22 +604,71 @@ thread_unblock (struct thread *t)
     thread_yield ();
 }
 
-/* Blocks the running thread until `time`. */
+/* Blocks the running thread until timer tick TIME.  Returns at
+   once if TIME has already passed. */
 void
 thread_wakemeupat (int64_t time)
 {
+  struct thread *cur = thread_current ();
   enum intr_level old_level;
 
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  thread_current ()->wakeup_time = time;
-  list_push_back (&sleep_list, &thread_current ()->elem);
-  ASSERT (!list_empty(&sleep_list));
-  thread_block ();
+  if (time > timer_ticks ())
+    {
+      cur->wakeup_time = time;
+      rb_insert (&sleep_tree, &cur->sleep_elem);
+      if (time < next_wakeup)
+        next_wakeup = time;
+      thread_block ();
+    }
   intr_set_level (old_level);
 }
 
+/* Blocks the running thread until timer_now_ns() reaches
+   DEADLINE, which should be less than a tick away.  Returns at
+   once if DEADLINE has already passed. */
+void
+thread_sleep_ns (int64_t deadline)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  if (deadline > timer_now_ns ())
+    {
+      cur->wakeup_time = deadline;
+      rb_insert (&deadline_tree, &cur->sleep_elem);
+      if (deadline < next_deadline)
+        {
+          next_deadline = deadline;
+          timer_arm_deadline ();
+        }
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the deadline of the next thread in thread_sleep_ns(),
+   or INT64_MAX if there is none. */
+int64_t
+thread_next_deadline (void)
+{
+  return next_deadline;
+}
+
+/* Unblocks the threads in thread_sleep_ns() whose deadline is
+   NOW_NS or earlier.  Returns true if one of them should preempt
+   the running thread.  Called by the timer interrupt. */
+bool
+thread_wake_deadlines (int64_t now_ns)
+{
+  return wake_expired (&deadline_tree, &next_deadline, now_ns);
+}
+
 /* Returns the name of the running thread. */
 const char *
 thread_name (void)
@@ -456,7 +747,11 @@ thread_exit (void)
 }
 
 /* Yields the CPU.  The current thread is not put to sleep and
-   may be scheduled again immediately at the scheduler's whim. */
+   may be scheduled again immediately at the scheduler's whim.
+
+   Under the completely fair scheduler, the current thread keeps
+   running unless its slice is used up or a ready thread lags
+   behind it by more than the minimum granularity. */
 void
 thread_yield (void)
 {
@@ -468,8 +763,23 @@ thread_yield (void)
   old_level = intr_disable ();
   if (cur != idle_thread)
     {
+      if (thread_mlfqs)
+        mlfqs_update (cur);
+      else if (thread_cfs)
+        {
+          struct rb_elem *e = rb_min (&cfs_tree);
+
+          cfs_charge ();
+          if (!cfs_resched
+              && (e == NULL
+                  || !cfs_lags (rb_entry (e, struct thread, run_elem))))
+            {
+              intr_set_level (old_level);
+              return;
+            }
+        }
       ASSERT_CLAMP (cur->priority, PRI_MIN, PRI_MAX);
-      list_push_back (&ready_list[get_pri (cur)], &cur->elem);
+      ready_push (cur);
     }
   cur->status = THREAD_READY;
   schedule ();
@@ -605,16 +915,14 @@ thread_get_priority (void)
 }
 
 /* Sets the current thread's nice value to NICE and
-   recalculate priority. */
+   recalculate priority, or weight under the completely fair
+   scheduler. */
 void
 thread_set_nice (int nice)
 {
-  int pri = thread_current ()->priority;
+  ASSERT (thread_mlfqs || thread_cfs);
+  ASSERT_CLAMP (nice, -20, 20);
 
-  ASSERT (thread_mlfqs);
-
-  pri += 2 * (thread_current ()->nice - nice);
-  thread_current ()->priority = CLAMP (pri, PRI_MIN, PRI_MAX);
   thread_current ()->nice = nice;
   thread_yield ();
 }
@@ -625,7 +933,7 @@ thread_get_nice (void)
 {
   struct thread *t = thread_current ();
 
-  ASSERT (thread_mlfqs);
+  ASSERT (thread_mlfqs || thread_cfs);
 
   ASSERT_CLAMP (t->nice, -20, 20);
   return t->nice;
@@ -672,6 +980,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing else can run.  With dynamic ticks, the timer
+         need not interrupt before the next sleeper wakes up. */
+      timer_tick_stop (next_wakeup);
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -738,6 +1050,7 @@ init_thread (struct thread *t, const char *name, int priority)
   t->base_priority = priority;
   t->priority      = PRI_MIN;
   t->wakeup_time   = INT64_MAX; /* Wake me up when September ends */
+  t->vruntime      = min_vruntime;
   list_init (&t->locks);
   if (running_thread () == t) /* initial thread */
     {
@@ -748,6 +1061,7 @@ init_thread (struct thread *t, const char *name, int priority)
     {
       t->nice = running_thread ()->nice;
       t->recent_cpu = running_thread ()->recent_cpu;
+      t->decay_epoch = running_thread ()->decay_epoch;
     }
   t->magic = THREAD_MAGIC;
 #ifdef USERPROG
@@ -764,7 +1078,8 @@ init_thread (struct thread *t, const char *name, int priority)
   /* User ESP on pagefault while handling syscall */
   t->esp = NULL;
   /* Local memory map management */
-  list_init (&t->mmap);
+  mmap_table_init (t);
+  t->heap_base = t->heap_brk = NULL;
 #endif /* VM */
 
   old_level = intr_disable ();
@@ -794,26 +1109,80 @@ thread_is_sleeping (struct thread *t)
   return (t->wakeup_time != INT64_MAX);
 }
 
-/* Check wakeup time of sleepers and if the current time is
-   later than that, unblock one.*/
+/* Unblocks the sleepers whose wakeup time is NOW or earlier.
+   Returns true if one of them should preempt the running
+   thread.  Called by the timer interrupt once per tick. */
+static bool
+thread_wakeup_sleepers (int64_t now)
+{
+  return wake_expired (&sleep_tree, &next_wakeup, now);
+}
+
+/* Unblocks the threads in TREE whose wakeup time is NOW or
+   earlier, keeping *NEXT as the earliest wakeup time left.
+   Returns true if one of them should preempt the running
+   thread. */
+static bool
+wake_expired (struct rbtree *tree, int64_t *next, int64_t now)
+{
+  int cur_pri = get_pri (thread_current ());
+  bool preempt = false;
+
+  if (thread_cfs && *next <= now)
+    cfs_charge ();
+
+  while (*next <= now)
+    {
+      struct rb_elem *e = rb_min (tree);
+      struct thread *t = rb_entry (e, struct thread, sleep_elem);
+
+      rb_remove (tree, e);
+      t->wakeup_time = INT64_MAX;
+      thread_unblock (t);
+      if (thread_cfs ? cfs_lags (t) : get_pri (t) > cur_pri)
+        preempt = true;
+
+      e = rb_min (tree);
+      *next = (e != NULL
+               ? rb_entry (e, struct thread, sleep_elem)->wakeup_time
+               : INT64_MAX);
+    }
+  return preempt;
+}
+
+/* Orders sleeping threads by wakeup time. */
+static bool
+wakeup_less (const struct rb_elem *a_, const struct rb_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = rb_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = rb_entry (b_, struct thread, sleep_elem);
+
+  return a->wakeup_time < b->wakeup_time;
+}
+
+/* Orders ready threads by virtual runtime. */
+static bool
+vruntime_less (const struct rb_elem *a_, const struct rb_elem *b_,
+               void *aux UNUSED)
+{
+  const struct thread *a = rb_entry (a_, struct thread, run_elem);
+  const struct thread *b = rb_entry (b_, struct thread, run_elem);
+
+  return a->vruntime < b->vruntime;
+}
+
+/* Adds T to the run queue. */
 static void
-thread_wakeup_sleepers (void)
+ready_push (struct thread *t)
 {
-  struct list_elem *e = list_begin (&sleep_list);
-  while (e != list_end (&sleep_list))
+  if (thread_cfs)
     {
-      struct thread *t = list_entry (e, struct thread, elem);
-      if (t->wakeup_time <= timer_ticks ())
-        {
-          t->wakeup_time = INT64_MAX;
-          e = list_remove (e);
-          thread_unblock (t);
-        }
-      else
-        {
-          e = list_next (e);
-        }
+      rb_insert (&cfs_tree, &t->run_elem);
+      cfs_tree_weight += cfs_weight (t);
     }
+  else
+    list_push_back (&ready_list[get_pri (t)], &t->elem);
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
@@ -826,11 +1195,31 @@ next_thread_to_run (void)
 {
   ASSERT (intr_get_level () == INTR_OFF);
 
-  thread_wakeup_sleepers ();
+  if (thread_cfs)
+    {
+      struct rb_elem *e = rb_min (&cfs_tree);
+      struct thread *t;
+
+      if (e == NULL)
+        return idle_thread;
+      t = rb_entry (e, struct thread, run_elem);
+      rb_remove (&cfs_tree, e);
+      cfs_tree_weight -= cfs_weight (t);
+      return t;
+    }
+
+  if (thread_mlfqs)
+    mlfqs_requeue_some ();
 
   for (int i=PRI_MAX;i>=PRI_MIN;i--)
     if (!list_empty (&ready_list[i]))
-      return list_entry (list_pop_front (&ready_list[i]), struct thread, elem);
+      {
+        struct thread *t = list_entry (list_pop_front (&ready_list[i]),
+                                       struct thread, elem);
+        if (thread_mlfqs)
+          mlfqs_update (t);
+        return t;
+      }
 
   return idle_thread;
 }
@@ -863,6 +1252,11 @@ thread_schedule_tail (struct thread *prev)
 
   /* Start new time slice. */
   thread_ticks = 0;
+  if (thread_cfs)
+    {
+      cfs_exec_start = cfs_slice_start = timer_now_ns ();
+      cfs_resched = false;
+    }
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -892,9 +1286,15 @@ static void
 schedule (void)
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct thread *next;
   struct thread *prev = NULL;
 
+  /* A thread that blocks or exits has not been charged yet.
+     (One that yields has, before it went into the run queue.) */
+  if (thread_cfs && cur->status != THREAD_READY)
+    cfs_charge ();
+  next = next_thread_to_run ();
+
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
@@ -2,7 +2,9 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 #include <ffloat.h>
 #include "threads/synch.h"
@@ -103,9 +105,13 @@ struct thread
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
     int base_priority;                  /* Priority without donation */
-    int64_t wakeup_time;                /* Tick to wake up at */
+    int64_t wakeup_time;                /* Tick, or ns, to wake up at */
+    struct rb_elem sleep_elem;          /* Element in sleep tree. */
     int nice;                           /* Nice value. */
     ffloat recent_cpu;                  /* Recent CPU time */
+    unsigned decay_epoch;               /* Epoch recent_cpu is decayed to */
+    int64_t vruntime;                   /* Weighted ns run, for -cfs */
+    struct rb_elem run_elem;            /* Element in run tree, for -cfs */
     struct list_elem allelem;           /* List element for all threads list. */
 
     /* Shared between thread.c and synch.c. */
@@ -115,6 +121,7 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct pagedir_batch *tlb_batch;    /* Deferred TLB invalidations. */
     /* Related to open() */
     int next_fd;                        /* Next file descriptor */
     struct list file;                   /* File list */
@@ -126,7 +133,13 @@ struct thread
 
 #ifdef VM
     uint32_t *esp;                      /* ESP storage for page fault*/
-    struct list mmap;                   /* Memory mappings list */
+    struct rbtree mmaps;                /* Memory mappings by address */
+    struct rbtree mmap_ids;             /* Memory mappings by id */
+    struct hash pages;                  /* Supplemental page table */
+    uint8_t *heap_base;                 /* Start of the heap */
+    uint8_t *heap_brk;                  /* Program break, end of heap */
+    size_t stack_limit;                 /* Most bytes of stack */
+    uint8_t *stack_bottom;              /* Lowest stack page */
 #endif
 
     /* Owned by thread.c. */
@@ -138,10 +151,16 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler, which orders ready
+   threads by virtual runtime weighted by their nice values.
+   Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_tick_idle (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -151,6 +170,9 @@ void thread_block (void);
 void thread_unblock (struct thread *);
 
 void thread_wakemeupat (int64_t time);
+void thread_sleep_ns (int64_t deadline);
+int64_t thread_next_deadline (void);
+bool thread_wake_deadlines (int64_t now_ns);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -53,8 +53,8 @@ static inline void *pg_round_down (const void *va) {
 #define	PHYS_BASE ((void *) LOADER_PHYS_BASE)
 
 #define EXEC_BASE ((void *) 0x08048000)
-#define MAX_STACK_SIZE (1 << 23)
-#define STACK_BASE ((uint8_t *)PHYS_BASE - MAX_STACK_SIZE)
+#define MAX_STACK_SIZE (1 << 23)   /* Default stack limit. */
+#define STACK_GUARD_SIZE (1 << 20) /* Kept unmapped below the limit. */
 
 /* Returns true if VADDR is a user virtual address. */
 static inline bool
@@ -6,8 +6,7 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #ifdef VM
-#include "threads/palloc.h"
-#include "userprog/pagedir.h"
+#include "vm/page.h"
 #endif /* VM */
 
 /* Number of page faults processed. */
@@ -17,7 +16,12 @@ static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
 #ifdef VM
+/* Pages beyond the faulting one that stack growth maps at once,
+   within the stack limit. */
+#define STACK_PREGROW 4
+
 static bool valid_stack_access (void *_addr, void *_esp, void *_eip);
+static bool grow_stack (void *fpage);
 #endif /* VM */
 
 /* Registers handlers for interrupts that can be caused by user
@@ -152,15 +156,20 @@ page_fault (struct intr_frame *f)
 #ifdef VM
   struct thread *t = thread_current ();
   void *fpage = pg_round_down (fault_addr);
-  if (pagedir_load_from_swap (thread_current ()->pagedir, fpage))
-    return;
-  if (pagedir_load_from_mmap (thread_current ()->pagedir, fpage))
-    return;
-  if (valid_stack_access (fault_addr, t->esp ? t->esp : f->esp, f->eip)
-      || pagedir_is_blank (thread_current ()->pagedir, fpage))
+  bool write = (f->error_code & PF_W) != 0;
+  bool write_protect = write && (f->error_code & PF_P) != 0;
+  if (is_user_vaddr (fault_addr) && t->pagedir != NULL)
     {
-      pagedir_add_blank (t->pagedir, fpage);
-      return;
+      if (write_protect)
+        {
+          if (page_copy_on_write (fpage))
+            return;
+        }
+      else if (page_load (fpage, write)
+               || (valid_stack_access (fault_addr, t->esp ? t->esp : f->esp,
+                                       f->eip)
+                   && grow_stack (fpage)))
+        return;
     }
 #endif /* VM */
 
@@ -207,14 +216,15 @@ valid_stack_access (void *_addr, void *_esp, void *_eip)
   uint8_t *esp  = _esp;
   uint8_t *eip  = _eip;
 
+  uint8_t *floor = (uint8_t *)PHYS_BASE - thread_current ()->stack_limit;
+
   if (eip == NULL)
     return false;
-  /* TODO: Fix this to (OVER BSS) */
   if (addr >= (uint8_t *)PHYS_BASE
-      || addr < STACK_BASE)
+      || addr < floor)
     return false;
   if (esp > (uint8_t *)PHYS_BASE
-      || esp < STACK_BASE)
+      || esp < floor)
     return false;
 
   if (esp <= addr)
@@ -242,4 +252,35 @@ valid_stack_access (void *_addr, void *_esp, void *_eip)
     }
   return (esp - preowned <= addr);
 }
+
+/* Grows the current process's stack down to FPAGE, which lies
+   below it within the stack limit.  Every page between FPAGE and
+   the old bottom of the stack is added and brought in at once,
+   along with STACK_PREGROW pages below FPAGE, so that a large
+   local array or a deep recursion takes one fault instead of one
+   per page.  Returns false if memory allocation fails. */
+static bool
+grow_stack (void *fpage)
+{
+  struct thread *t = thread_current ();
+  uint8_t *floor = (uint8_t *)PHYS_BASE - t->stack_limit;
+  uint8_t *old_bottom = t->stack_bottom;
+  uint8_t *bottom = fpage;
+
+  if (bottom >= old_bottom)
+    return page_add_zero (fpage, true) && page_load (fpage, true);
+
+  if ((size_t) (bottom - floor) >= STACK_PREGROW * PGSIZE)
+    bottom -= STACK_PREGROW * PGSIZE;
+  else
+    bottom = pg_round_up (floor);
+
+  for (uint8_t *page = bottom; page < old_bottom; page += PGSIZE)
+    if (!page_add_zero (page, true) && page == fpage)
+      return false;
+  t->stack_bottom = bottom;
+
+  page_populate_range (bottom, old_bottom - bottom);
+  return true;
+}
 #endif /* VM */
@@ -6,14 +6,11 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
-#ifdef VM
 #include "threads/thread.h"
-#include "vm/swap-alloc.h"
-#include "vm/mmap.h"
-#endif /* VM */
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *vpage);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -46,14 +43,8 @@ pagedir_destroy (uint32_t *pd)
         uint32_t *pte;
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          {
-            if (*pte & PTE_P)
-              palloc_free_page (pte_get_page (*pte));
-#ifdef VM
-            else if (pte_is_swapped (*pte))
-              swap_destroy_page (pte_get_swap_idx (*pte));
-#endif /* VM */
-          }
+          if (*pte & PTE_P) 
+            palloc_free_page (pte_get_page (*pte));
         palloc_free_page (pt);
       }
   palloc_free_page (pd);
@@ -164,7 +155,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -192,247 +183,65 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
-/* Returns true if the PTE for virtual page VPAGE in PD has been
-   accessed recently, that is, between the time the PTE was
-   installed and the last time it was cleared.  Returns false if
-   PD contains no PTE for VPAGE. */
+/* Returns true if the PTE for virtual page VPAGE in PD is
+   writable.  Returns false if PD contains no PTE for VPAGE. */
 bool
-pagedir_is_accessed (uint32_t *pd, const void *vpage) 
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
 {
   uint32_t *pte = lookup_page (pd, vpage, false);
-  return pte != NULL && (*pte & PTE_A) != 0;
+  return pte != NULL && (*pte & PTE_W) != 0;
 }
 
-/* Sets the accessed bit to ACCESSED in the PTE for virtual page
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
    VPAGE in PD. */
 void
-pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
 {
   uint32_t *pte = lookup_page (pd, vpage, false);
   if (pte != NULL) 
     {
-      if (accessed)
-        *pte |= PTE_A;
+      if (writable)
+        *pte |= PTE_W;
       else 
-        {
-          *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
-        }
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, vpage);
     }
 }
 
-#ifdef VM
-void
-pagedir_save_to_swap (uint32_t *pd, const void *vpage)
-{
-  uint32_t *pte = lookup_page (pd, vpage, false);
-  uint32_t *page;
-  size_t    swap;
-
-  ASSERT (pte != NULL && !pte_is_swapped (*pte));
-
-  page = pte_get_page (*pte);
-  swap = swap_store_page (page);
-  ASSERT (swap_is_valid (swap));
-  palloc_free_page (page);
-  *pte = pte_set_as_swap (*pte, swap);
-
-  invalidate_pagedir (pd);
-}
-
+/* Returns true if the PTE for virtual page VPAGE in PD has been
+   accessed recently, that is, between the time the PTE was
+   installed and the last time it was cleared.  Returns false if
+   PD contains no PTE for VPAGE. */
 bool
-pagedir_load_from_swap (uint32_t *pd, void *vpage)
+pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
   uint32_t *pte = lookup_page (pd, vpage, false);
-  uint32_t *page;
-  size_t    swap;
-
-  if (pte == NULL || !pte_is_swapped (*pte))
-    return false;
-
-  swap = pte_get_swap_idx (*pte);
-  page = palloc_get_page (pte_is_user (*pte) ? PAL_USER : 0);
-  *pte = pte_set_as_page (*pte, page);
-  swap_load_page (swap, page);
-
-  invalidate_pagedir (pd);
-  return true;
+  return pte != NULL && (*pte & PTE_A) != 0;
 }
 
+/* Sets the accessed bit to ACCESSED in the PTE for virtual page
+   VPAGE in PD. */
 void
-pagedir_evict_page (uint32_t *pd, void *esp)
+pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
 {
-  /* Free invalid stack page */
-  for (uint8_t *p = STACK_BASE;
-       p < (uint8_t *)pg_round_down (esp);
-       p += PGSIZE)
-    {
-      uint32_t *pte = lookup_page(pd, p, false);
-
-      if (pte_is_swapped (*pte))
-        {
-          swap_destroy_page (pte_get_swap_idx (*pte));
-          *pte = 0;
-        }
-      else if (*pte & PTE_A)
-        palloc_free_page (pte_get_page (*pte));
-
-      *pte = *pte & !PTE_P;
-      return;
-    }
-
-  void *alive     = NULL;
-  void *unvisited = NULL;
-  void *unwritten = NULL;
-
-  /* Swap stack page */
-  for (uint8_t *p = (uint8_t *)pg_round_down (esp);
-       p < (uint8_t *)PHYS_BASE;
-       p += PGSIZE)
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
     {
-      uint32_t *pte = lookup_page (pd, p, false);
-      if (pte != NULL && (*pte & PTE_P))
+      if (accessed)
+        *pte |= PTE_A;
+      else 
         {
-          if (!(*pte & PTE_A))
-            unvisited = p;
-          else if (!(*pte & PTE_D))
-            unwritten = p;
-          else
-            alive = p;
-          *pte = *pte & ~PTE_A & ~PTE_D;
+          *pte &= ~(uint32_t) PTE_A; 
+          invalidate_page (pd, vpage);
         }
     }
-
-  if (unvisited != NULL)
-    {
-      pagedir_save_to_swap (pd, unvisited);
-      return;
-    }
-
-  /* Swap program area */
-  for (uint8_t *p = (uint8_t *)EXEC_BASE; ;p += PGSIZE)
-    {
-      uint32_t *pte = lookup_page (pd, p, false);
-      if (pte == NULL || !pte_is_used (*pte))
-        break;
-      if (!(*pte & PTE_P)) //|| !(*pte & PTE_W))
-        continue;
-
-      alive = p;
-      if (!(*pte & PTE_A))
-        unvisited = p;
-      *pte = *pte & ~PTE_A;
-    }
-
-  if (unvisited != NULL)
-    {
-      pagedir_save_to_swap (pd, unvisited);
-      return;
-    }
-  if (unwritten != NULL)
-    {
-      pagedir_save_to_swap (pd, unwritten);
-      return;
-    }
-  if (alive != NULL)
-    {
-      pagedir_save_to_swap (pd, alive);
-      return;
-    }
-}
-
-void
-pagedir_add_blank (uint32_t *pd, void *vpage)
-{
-  uint8_t *page = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (page == NULL)
-    PANIC ("Failed to allocate stack memory");
-  pagedir_set_page (pd, vpage, page, true);
-}
-
-bool
-pagedir_load_from_mmap (uint32_t *pd, void *vpage)
-{
-  uint32_t *pte = lookup_page (pd, vpage, false);
-  uint32_t *page;
-  mapid_t   mid;
-
-  if (pte == NULL || !pte_is_mmapped (*pte))
-    return false;
-
-  mid  = pte_get_swap_idx (*pte);
-  page = palloc_get_page (PAL_USER | PAL_ZERO);
-  *pte = pte_set_as_page (*pte, page);
-  ASSERT (mmap_load_page (mid, vpage));
-
-  invalidate_pagedir (pd);
-  return true;
-}
-
-bool
-pagedir_setup_mmap (uint32_t *pd,  void *vpage, mapid_t mapid, size_t size)
-{
-  uint8_t *p_addr = vpage;
-
-  if (pg_round_down (vpage) != vpage)
-    return false;
-
-  for (uint8_t *p = p_addr; p < p_addr + ROUND_UP (size, PGSIZE); p += PGSIZE)
-    {
-      uint32_t *pte = lookup_page (pd, p_addr, false);
-      if (pte != NULL && pte_is_used (*pte))
-        return false;
-    }
-
-  for (uint8_t *p = p_addr; p < p_addr + ROUND_UP (size, PGSIZE); p += PGSIZE)
-    {
-      uint32_t *pte = lookup_page (pd, p, true);
-      *pte = pte_create_mmap (mapid);
-    }
-
-  invalidate_pagedir (pd);
-  return true;
 }
 
-void
-pagedir_clear_mmap (uint32_t *pd,  void *vpage, size_t size)
-{
-  uint8_t *p_addr = vpage;
-
-  ASSERT (pg_round_down (vpage) == vpage);
-
-  for (uint8_t *p = p_addr; p < p_addr + ROUND_UP (size, PGSIZE); p += PGSIZE)
-    {
-      void *page = pagedir_get_page (pd, p);
-      if (page != NULL)
-        palloc_free_page (page);
-      *lookup_page (pd, p, true) = 0;
-    }
-
-  invalidate_pagedir (pd);
-}
-
-bool
-pagedir_is_blank (uint32_t *pd, void *vpage)
-{
-  uint32_t *pte = lookup_page (pd, vpage, false);
-  return pte != NULL && pte_is_blank (*pte);
-}
-
-void
-pagedir_set_blank (uint32_t *pd, void *vpage, bool writable)
-{
-  uint32_t *pte = lookup_page (pd, vpage, true);
-  *pte = pte_create_blank (writable);
-}
-
-#endif /* VM */
-
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -449,6 +258,37 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Starts deferring the TLB invalidations that changes to PD by
+   the current thread call for, until pagedir_batch_end(), so
+   that a run of changes costs one flush.  Until then, the
+   current thread must not access the pages it changes. */
+void
+pagedir_batch_begin (struct pagedir_batch *b, uint32_t *pd)
+{
+  struct thread *t = thread_current ();
+
+  b->pd = pd;
+  b->cnt = 0;
+  b->outer = t->tlb_batch;
+  t->tlb_batch = b;
+}
+
+/* Carries out the invalidations deferred by B, page by page, or
+   by flushing the whole TLB if there were too many of them. */
+void
+pagedir_batch_end (struct pagedir_batch *b)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->tlb_batch == b);
+  t->tlb_batch = b->outer;
+  if (b->cnt > PAGEDIR_BATCH_MAX)
+    invalidate_pagedir (b->pd);
+  else
+    for (size_t i = 0; i < b->cnt; i++)
+      invalidate_page (b->pd, b->pages[i]);
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
@@ -462,6 +302,28 @@ active_pd (void)
   return ptov (pd);
 }
 
+/* Invalidates the TLB entry for VPAGE if PD is the active page
+   directory, or defers it if the current thread is batching
+   changes to PD. */
+static void
+invalidate_page (uint32_t *pd, const void *vpage)
+{
+  struct pagedir_batch *b = thread_current ()->tlb_batch;
+
+  if (b != NULL && b->pd == pd)
+    {
+      if (b->cnt < PAGEDIR_BATCH_MAX)
+        b->pages[b->cnt] = vpage;
+      b->cnt++;
+    }
+  else if (active_pd () == pd)
+    {
+      /* See [IA32-v3a] 3.12 "Translation Lookaside Buffers
+         (TLBs)" and [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+      asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+    }
+}
+
 /* Seom page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
    table.  When this happens, we have to "invalidate" the TLB by
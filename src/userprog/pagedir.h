@@ -4,7 +4,20 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
-#include "vm/mmap.h"
+
+/* Most pages a batch invalidates one at a time.  Past that, the
+   whole TLB is flushed instead. */
+#define PAGEDIR_BATCH_MAX 32
+
+/* TLB invalidations deferred between pagedir_batch_begin() and
+   pagedir_batch_end(). */
+struct pagedir_batch
+  {
+    uint32_t *pd;                       /* Page directory. */
+    size_t cnt;                         /* Number of pages deferred. */
+    const void *pages[PAGEDIR_BATCH_MAX]; /* Pages to invalidate. */
+    struct pagedir_batch *outer;        /* Enclosing batch, if any. */
+  };
 
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
@@ -13,22 +26,13 @@ void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
-#ifdef VM
-void pagedir_evict_page     (uint32_t *pd, void *esp);
-void pagedir_save_to_swap   (uint32_t *pd, const void *vpage);
-bool pagedir_load_from_swap (uint32_t *pd, void *vpage);
-bool pagedir_load_from_mmap (uint32_t *pd, void *vpage);
-void pagedir_add_blank      (uint32_t *pd, void *vpage);
-bool pagedir_setup_mmap     (uint32_t *pd, void *vpage,
-                             mapid_t mapid, size_t size);
-void pagedir_clear_mmap     (uint32_t *pd, void *vpage,
-                             size_t size);
-bool pagedir_is_blank       (uint32_t *pd, void *vpage);
-void pagedir_set_blank      (uint32_t *pd, void *vpage,
-                             bool writable);
-#endif /* VM */
+
+void pagedir_batch_begin (struct pagedir_batch *, uint32_t *pd);
+void pagedir_batch_end (struct pagedir_batch *);
 
 #endif /* userprog/pagedir.h */
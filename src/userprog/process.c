@@ -23,10 +23,16 @@
 
 #ifdef VM
 #include "vm/mmap.h"
+#include "vm/page.h"
 #include "vm/swap-alloc.h"
 #endif
 
 static thread_func start_process NO_RETURN;
+#ifdef VM
+static thread_func fork_process NO_RETURN;
+
+size_t process_stack_limit = MAX_STACK_SIZE;
+#endif /* VM */
 static void free_subthread_list (struct thread *t);
 static void mark_exit_on_return_value (struct thread *t);
 static bool load (char *arg_str, void (**eip) (void), void **esp);
@@ -106,6 +112,80 @@ start_process (void *arg_str_)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Hands the parent's state to the child of fork(). */
+struct fork_args
+  {
+    struct intr_frame if_;      /* Parent's user context. */
+    struct thread *parent;      /* Parent, blocked until we are done. */
+  };
+
+/* Starts a new process that is a copy of the current one, which
+   entered the kernel with user context F.  The child returns 0
+   from the system call; the parent gets the child's thread id,
+   or TID_ERROR if the child could not be created. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct fork_args *args;
+  tid_t tid;
+
+  args = malloc (sizeof *args);
+  if (args == NULL)
+    return TID_ERROR;
+  args->if_ = *f;
+  args->parent = thread_current ();
+
+  tid = thread_create (thread_name (), PRI_DEFAULT, fork_process, args);
+  if (tid == TID_ERROR)
+    {
+      free (args);
+      return TID_ERROR;
+    }
+  return process_wait_load (tid);
+}
+
+/* A thread function that copies the parent's address space and
+   file descriptors and returns to user mode as the child of
+   fork(). */
+static void
+fork_process (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *t = thread_current ();
+  struct thread *parent = args->parent;
+  struct intr_frame if_ = args->if_;
+  bool success;
+
+  free (args);
+
+  t->next_fd = parent->next_fd;
+  t->heap_base = parent->heap_base;
+  t->heap_brk = parent->heap_brk;
+  t->stack_limit = parent->stack_limit;
+  t->stack_bottom = parent->stack_bottom;
+  if (page_table_init ())
+    t->pagedir = pagedir_create ();
+  success = (t->pagedir != NULL
+             && page_table_fork (parent)
+             && user_io_fork (parent)
+             && mmap_fork (parent));
+  process_activate ();
+
+  if (!success)
+    {
+      t->val = -1;
+      thread_exit ();
+    }
+
+  sema_up (&t->return_val->sema);
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif /* VM */
+
 static struct return_value *
 find_thread_return_value (tid_t tid)
 {
@@ -246,6 +326,9 @@ process_exit (void)
          that's been freed (and cleared). */
       cur->pagedir = NULL;
       pagedir_activate (NULL);
+#ifdef VM
+      page_table_destroy ();
+#endif /* VM */
       pagedir_destroy (pd);
     }
 }
@@ -353,6 +436,10 @@ load (char *arg_str, void (**eip) (void), void **esp)
   int i;
 
   /* Allocate and activate page directory. */
+#ifdef VM
+  if (!page_table_init ())
+    goto done;
+#endif /* VM */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
@@ -438,6 +525,12 @@ load (char *arg_str, void (**eip) (void), void **esp)
               if (!load_segment (file, file_page, (void *) mem_page,
                                  read_bytes, zero_bytes, writable))
                 goto done;
+#ifdef VM
+              /* The heap starts after the last segment. */
+              if ((uint8_t *) mem_page + read_bytes + zero_bytes
+                  > t->heap_base)
+                t->heap_base = (uint8_t *) mem_page + read_bytes + zero_bytes;
+#endif /* VM */
             }
           else
             goto done;
@@ -445,6 +538,11 @@ load (char *arg_str, void (**eip) (void), void **esp)
         }
     }
 
+#ifdef VM
+  t->heap_brk = t->heap_base;
+  t->stack_limit = process_stack_limit;
+#endif /* VM */
+
   /* Set up stack. */
   if (!setup_stack (esp, arg_str))
     goto done;
@@ -464,7 +562,9 @@ load (char *arg_str, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -533,6 +633,27 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* Pages holding file data are read in on first access, the
+     rest start out as blank pages, unless the whole segment is
+     to be brought in now. */
+  uint32_t file_pages = DIV_ROUND_UP (read_bytes, PGSIZE);
+  uint8_t *base = upage;
+  size_t length = read_bytes + zero_bytes;
+
+  if (read_bytes > 0
+      && !mmap_segment (file, ofs, upage, read_bytes, writable))
+    return false;
+
+  upage += file_pages * PGSIZE;
+  zero_bytes -= file_pages * PGSIZE - read_bytes;
+  for (; zero_bytes > 0; zero_bytes -= PGSIZE, upage += PGSIZE)
+    if (!page_add_zero (upage, writable))
+      return false;
+
+  if (mmap_prefault_exec)
+    page_populate_range (base, length);
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -542,43 +663,32 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-#ifdef VM
-      if (page_read_bytes == 0)
+      /* Get a page of memory. */
+      uint8_t *kpage = palloc_get_page (PAL_USER);
+      if (kpage == NULL)
+        return false;
+
+      /* Load this page. */
+      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
         {
-          pagedir_set_blank (thread_current ()->pagedir, upage, writable);
+          palloc_free_page (kpage);
+          return false; 
         }
-      else
-        {
-#endif /* VM */
-          /* Get a page of memory. */
-          uint8_t *kpage = palloc_get_page (PAL_USER);
-          if (kpage == NULL)
-            return false;
+      memset (kpage + page_read_bytes, 0, page_zero_bytes);
 
-          /* Load this page. */
-          if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-            {
-              palloc_free_page (kpage);
-              return false; 
-            }
-          memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-          /* Add the page to the process's address space. */
-          if (!install_page (upage, kpage, writable)) 
-            {
-              palloc_free_page (kpage);
-              return false; 
-            }
-#ifdef VM
-          if (writable)
-            pagedir_save_to_swap (thread_current ()->pagedir, upage);
+      /* Add the page to the process's address space. */
+      if (!install_page (upage, kpage, writable)) 
+        {
+          palloc_free_page (kpage);
+          return false; 
         }
-#endif /* VM */
+
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
       upage += PGSIZE;
     }
+#endif /* VM */
   return true;
 }
 
@@ -649,22 +759,28 @@ setup_argc_argv (char *page, char *arg_str)
 static bool
 setup_stack (void **esp, char *arg_str)
 {
-  uint8_t *kpage;
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
   bool success = false;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#ifdef VM
+  success = page_add_zero (upage, true) && page_load (upage, true);
+  thread_current ()->stack_bottom = upage;
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = setup_argc_argv((void *)PHYS_BASE, arg_str);
-      else
+      success = install_page (upage, kpage, true);
+      if (!success)
         palloc_free_page (kpage);
     }
+#endif /* VM */
+  if (success)
+    *esp = setup_argc_argv ((void *) PHYS_BASE, arg_str);
 
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -684,3 +800,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif /* !VM */
@@ -1,9 +1,17 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 
 tid_t process_execute (const char *file_name);
+#ifdef VM
+/* Stack limit of new processes, in bytes.
+   Controlled by kernel command-line option "-sl". */
+extern size_t process_stack_limit;
+
+tid_t process_fork (const struct intr_frame *);
+#endif
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
@@ -8,6 +8,9 @@
 #include "threads/vaddr.h"
 #include "userprog/process.h"
 #include "userprog/user-io.h"
+#ifdef VM
+#include "vm/mmap.h"
+#endif /* VM */
 
 typedef int pid_t;
 
@@ -44,8 +47,15 @@ static unsigned __tell (int fd);
 static void __close (int fd);
 
 #ifdef VM
+static int  __fork (struct intr_frame *f);
 static int  __mmap (int fd, void *addr);
+static int  __mmap_flags (int fd, void *addr, int flags);
 static void __munmap (int mid);
+static bool __msync (void *addr, unsigned length);
+static bool __madvise (void *addr, unsigned length, int advice);
+static void *__sbrk (intptr_t increment);
+static void *__mmap_anon (void *addr, unsigned length);
+static void __munmap_anon (void *addr);
 #endif /* VM */
 
 /* (END  ) system call wrappers prototype */
@@ -105,16 +115,19 @@ assert_arr_sanity (const uint8_t *arr, unsigned size, bool w)
   if (arr == NULL)
     __exit (-1);
 
-  if (w &&
-         (!put_user ((void *)arr,           (uint8_t) 0)
-       || !put_user ((void *)(arr +size-1), (uint8_t) 0)))
-    __exit (-1);
-
-  if (get_user ((void *)arr) == -1 || get_user ((void *)(arr +size-1)) == -1)
-    __exit (-1);
-
   if (!is_user_vaddr (arr + size-1))
     __exit (-1);
+
+  /* Touch every page so that lazily loaded pages are brought in
+     now rather than in the middle of a file system access. */
+  for (const uint8_t *p = pg_round_down (arr); p <= arr + size-1; p += PGSIZE)
+    {
+      const uint8_t *q = p < arr ? arr : p;
+      if (w && !put_user ((void *)q, (uint8_t) 0))
+        __exit (-1);
+      if (get_user (q) == -1)
+        __exit (-1);
+    }
 }
 
 static void
@@ -194,12 +207,33 @@ syscall_handler (struct intr_frame *f)
       CALL_1 (__close, *esp, int);
       break;
 #ifdef VM
+    case SYS_FORK:
+      f->eax = __fork (f);
+      break;
     case SYS_MMAP:
       f->eax = CALL_2 (__mmap, *esp, int, void *);
       break;
+    case SYS_MMAP_FLAGS:
+      f->eax = CALL_3 (__mmap_flags, *esp, int, void *, int);
+      break;
     case SYS_MUNMAP:
       CALL_1 (__munmap, *esp, int);
       break;
+    case SYS_MSYNC:
+      f->eax = CALL_2 (__msync, *esp, void *, unsigned);
+      break;
+    case SYS_MADVISE:
+      f->eax = CALL_3 (__madvise, *esp, void *, unsigned, int);
+      break;
+    case SYS_SBRK:
+      f->eax = (uint32_t) CALL_1 (__sbrk, *esp, intptr_t);
+      break;
+    case SYS_MMAP_ANON:
+      f->eax = (uint32_t) CALL_2 (__mmap_anon, *esp, void *, unsigned);
+      break;
+    case SYS_MUNMAP_ANON:
+      CALL_1 (__munmap_anon, *esp, void *);
+      break;
 #endif /* VM */
     default :
       __exit (-1);
@@ -306,10 +340,22 @@ __close (int fd)
 
 #ifdef VM
 
+static int
+__fork (struct intr_frame *f)
+{
+  return process_fork (f);
+}
+
 static int
 __mmap (int fd, void *addr)
 {
-  return user_io_mmap (fd, addr);
+  return user_io_mmap (fd, addr, 0);
+}
+
+static int
+__mmap_flags (int fd, void *addr, int flags)
+{
+  return user_io_mmap (fd, addr, flags);
 }
 
 static void
@@ -317,6 +363,36 @@ __munmap (int mid)
 {
   user_io_munmap (mid);
 }
+
+static bool
+__msync (void *addr, unsigned length)
+{
+  return user_io_msync (addr, length);
+}
+
+static bool
+__madvise (void *addr, unsigned length, int advice)
+{
+  return user_io_madvise (addr, length, advice);
+}
+
+static void *
+__sbrk (intptr_t increment)
+{
+  return mmap_sbrk (increment);
+}
+
+static void *
+__mmap_anon (void *addr, unsigned length)
+{
+  return mmap_anon (addr, length);
+}
+
+static void
+__munmap_anon (void *addr)
+{
+  munmap_anon (addr);
+}
 #endif /* VM */
 
 /* (END  ) system call wrappers implementation */
@@ -20,6 +20,7 @@ struct user_file
 {
   struct file *file;
   int fd;
+  bool deny_write;
   struct list_elem elem;
 };
 
@@ -50,7 +51,7 @@ static void io_deny_write (int fd);
 
 #ifdef VM
 
-static int  io_mmap (int fd, void *addr);
+static int  io_mmap (int fd, void *addr, int flags);
 static void io_munmap (int mid);
 
 #endif /* VM */
@@ -72,6 +73,7 @@ alloc_user_file ()
     return NULL;
 
   ufile->fd = get_fd ();
+  ufile->deny_write = false;
 
   return ufile;
 }
@@ -220,12 +222,13 @@ static void io_deny_write (int fd)
     return;
 
   file_deny_write (ufile->file);
+  ufile->deny_write = true;
 }
 
 #ifdef VM
 
 static int
-io_mmap (int fd, void *addr)
+io_mmap (int fd, void *addr, int flags)
 {
   struct user_file *ufile;
 
@@ -235,7 +238,7 @@ io_mmap (int fd, void *addr)
   if ((ufile = find_user_file (fd)) == NULL)
     return -1;
 
-  return mmap (ufile->file, addr);
+  return mmap (ufile->file, addr, flags);
 }
 
 static void
@@ -268,6 +271,36 @@ user_io_release (void)
   lock_release (&io_lock);
 }
 
+/* Acquires the I/O lock unless the current thread already holds
+   it, as happens when a page is faulted in from a file in the
+   middle of a read() or write().  Returns true if the lock was
+   acquired here and must be released with user_io_release(). */
+bool
+user_io_block_nested (void)
+{
+  if (lock_held_by_current_thread (&io_lock))
+    return false;
+  lock_acquire (&io_lock);
+  return true;
+}
+
+/* Acquires the I/O lock if nobody holds it, without waiting.
+   Returns true if successful.  Used by eviction, which must not
+   wait for the lock while holding the frame table lock. */
+bool
+user_io_try_block (void)
+{
+  return (!lock_held_by_current_thread (&io_lock)
+          && lock_try_acquire (&io_lock));
+}
+
+/* Returns true if the current thread holds the I/O lock. */
+bool
+user_io_held (void)
+{
+  return lock_held_by_current_thread (&io_lock);
+}
+
 void
 user_io_close_all (void)
 {
@@ -288,6 +321,43 @@ user_io_close_all (void)
     }
 }
 
+/* Gives the current thread a copy of every file descriptor of
+   PARENT, for fork().  Each copy is a separate struct file at the
+   same position.  Returns false if out of memory. */
+bool
+user_io_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+  bool success = true;
+
+  lock_acquire (&io_lock);
+  for (e = list_begin (&parent->file);
+       e != list_end (&parent->file);
+       e = list_next (e))
+    {
+      struct user_file *pfile = list_entry (e, struct user_file, elem);
+      struct user_file *ufile = malloc (sizeof (struct user_file));
+
+      if (ufile == NULL
+          || (ufile->file = file_reopen (pfile->file)) == NULL)
+        {
+          free (ufile);
+          success = false;
+          break;
+        }
+      ufile->fd = pfile->fd;
+      ufile->deny_write = pfile->deny_write;
+      file_seek (ufile->file, file_tell (pfile->file));
+      if (ufile->deny_write)
+        file_deny_write (ufile->file);
+      list_push_back (&t->file, &ufile->elem);
+    }
+  lock_release (&io_lock);
+
+  return success;
+}
+
 bool
 user_io_create (const char *file, unsigned initial_size)
 {
@@ -384,11 +454,11 @@ user_io_deny_write (int fd)
 
 #ifdef VM
 int
-user_io_mmap (int fd, void *addr)
+user_io_mmap (int fd, void *addr, int flags)
 {
   int mid;
   lock_acquire (&io_lock);
-  mid = io_mmap (fd, addr);
+  mid = io_mmap (fd, addr, flags);
   lock_release (&io_lock);
   return mid;
 }
@@ -400,4 +470,24 @@ user_io_munmap (int mid)
   io_munmap (mid);
   lock_release (&io_lock);
 }
+
+bool
+user_io_msync (void *addr, unsigned length)
+{
+  bool success;
+  lock_acquire (&io_lock);
+  success = mmap_sync (addr, length);
+  lock_release (&io_lock);
+  return success;
+}
+
+bool
+user_io_madvise (void *addr, unsigned length, int advice)
+{
+  bool success;
+  lock_acquire (&io_lock);
+  success = mmap_advise (addr, length, advice);
+  lock_release (&io_lock);
+  return success;
+}
 #endif /* VM */
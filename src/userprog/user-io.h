@@ -2,11 +2,16 @@
 #define USERPROG_USER_IO_H
 
 #include <stdbool.h>
+#include "threads/thread.h"
 
 void user_io_init      (void);
 void user_io_block     (void);
 void user_io_release   (void);
+bool user_io_block_nested (void);
+bool user_io_try_block (void);
+bool user_io_held      (void);
 void user_io_close_all (void);
+bool user_io_fork      (struct thread *parent);
 bool user_io_create    (const char *file, unsigned initial_size);
 bool user_io_remove    (const char *file);
 int  user_io_open      (const char *file);
@@ -20,8 +25,10 @@ void user_io_close     (int fd);
 void user_io_deny_write (int fd);
 
 #ifdef VM
-int  user_io_mmap (int fd, void *addr);
+int  user_io_mmap (int fd, void *addr, int flags);
 void user_io_munmap (int mid);
+bool user_io_msync (void *addr, unsigned length);
+bool user_io_madvise (void *addr, unsigned length, int advice);
 #endif /* VM */
 
 #endif /* USERPROG_USER_IO_H */
@@ -0,0 +1,584 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <bitmap.h>
+#include <list.h>
+#include <round.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/user-io.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/pcache.h"
+#include "vm/swap-alloc.h"
+
+/* Frame table.  Keeps one entry for every page of the user pool,
+   recording every supplemental page table entry that maps it.  Frames
+   that are allocated but not yet mapped (or not mapped by a user
+   page directory at all) have no mappings and are never evicted,
+   nor are frames pinned with frame_pin().  The exception is a
+   page cache frame that pcache_put() left dirty when its last
+   mapping went away, which eviction writes back.
+
+   Eviction runs a clock hand over the table.  A frame that has
+   been accessed through any of its mappings gets a second
+   chance: the accessed bits are cleared and the hand moves on.
+   On the first lap dirty frames are skipped as well, so clean
+   frames are preferred as victims. */
+
+/* Most frames written to swap by one eviction. */
+#define SWAP_CLUSTER 8
+
+/* A user frame. */
+struct frame
+  {
+    struct list maps;                   /* List of struct page. */
+    unsigned pin_cnt;                   /* Pinned frames are not evicted. */
+    bool cached;                        /* Owned by the page cache. */
+  };
+
+static struct frame *frames;            /* Frame table. */
+static size_t frame_cnt;                /* Number of entries. */
+static uint8_t *frame_base;             /* Kernel address of frame 0. */
+static size_t clock_hand;               /* Next frame to examine. */
+
+/* Protects the frame table, the page cache and every page table
+   entry that points into them.  May be acquired recursively by
+   its holder, since evicting a frame frees it through palloc. */
+static struct lock frame_table_lock;
+static int frame_lock_depth;
+
+static struct frame *lookup_frame (void *kpage);
+static void *frame_page (struct frame *);
+static bool frame_accessed (struct frame *);
+static bool frame_dirty (struct frame *);
+static bool evict_frame (struct frame *);
+static bool evict_to_file (struct frame *);
+static size_t gather_cluster (struct frame *f,
+                              struct frame *cluster[SWAP_CLUSTER]);
+
+/* Initializes the frame table to cover PAGE_CNT frames starting
+   at kernel virtual address BASE. */
+void
+frame_init (void *base, size_t page_cnt)
+{
+  size_t ft_pages = DIV_ROUND_UP (page_cnt * sizeof *frames, PGSIZE);
+
+  frames = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, ft_pages);
+  frame_cnt = page_cnt;
+  frame_base = base;
+  clock_hand = 0;
+  for (size_t i = 0; i < frame_cnt; i++)
+    list_init (&frames[i].maps);
+  lock_init (&frame_table_lock);
+  frame_lock_depth = 0;
+}
+
+/* Acquires the frame table lock. */
+void
+frame_lock (void)
+{
+  if (lock_held_by_current_thread (&frame_table_lock))
+    {
+      frame_lock_depth++;
+      return;
+    }
+  lock_acquire (&frame_table_lock);
+  frame_lock_depth = 1;
+}
+
+/* Releases the frame table lock. */
+void
+frame_unlock (void)
+{
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  if (--frame_lock_depth == 0)
+    lock_release (&frame_table_lock);
+}
+
+/* Records that user frame KPAGE holds page P.  KPAGE outside of
+   the user pool is ignored. */
+void
+frame_map (void *kpage, struct page *p)
+{
+  struct frame *f = lookup_frame (kpage);
+
+  if (f == NULL)
+    return;
+
+  frame_lock ();
+  list_push_back (&f->maps, &p->frame_elem);
+  frame_unlock ();
+}
+
+/* Forgets that KPAGE holds page P.  If P was written through, the
+   mappings that remain are marked dirty, since they alone now
+   record that the frame differs from its backing store.  (Clearing
+   P's page table entry leaves its dirty bit alone.)  Returns true
+   if the frame is still mapped or pinned elsewhere. */
+bool
+frame_unmap (void *kpage, struct page *p)
+{
+  struct frame *f = lookup_frame (kpage);
+  struct list_elem *e;
+  bool in_use;
+
+  if (f == NULL)
+    return false;
+
+  frame_lock ();
+  list_remove (&p->frame_elem);
+  if (p->dirty || pagedir_is_dirty (p->pd, p->upage))
+    for (e = list_begin (&f->maps); e != list_end (&f->maps);
+         e = list_next (e))
+      list_entry (e, struct page, frame_elem)->dirty = true;
+  in_use = !list_empty (&f->maps) || f->pin_cnt > 0;
+  frame_unlock ();
+
+  return in_use;
+}
+
+/* Returns true if KPAGE is mapped more than once. */
+bool
+frame_is_shared (void *kpage)
+{
+  struct frame *f = lookup_frame (kpage);
+  bool shared;
+
+  if (f == NULL)
+    return false;
+
+  frame_lock ();
+  shared = list_size (&f->maps) > 1;
+  frame_unlock ();
+  return shared;
+}
+
+/* Clears the dirty bit of every mapping of user frame KPAGE.
+   Returns true if any of them was set. */
+bool
+frame_clean (void *kpage)
+{
+  struct frame *f = lookup_frame (kpage);
+  struct list_elem *e;
+  bool dirty = false;
+
+  if (f == NULL)
+    return false;
+
+  frame_lock ();
+  for (e = list_begin (&f->maps); e != list_end (&f->maps); e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_dirty (p->pd, p->upage))
+        {
+          pagedir_set_dirty (p->pd, p->upage, false);
+          dirty = true;
+        }
+    }
+  frame_unlock ();
+  return dirty;
+}
+
+/* Forgets every mapping of user frame KPAGE. */
+void
+frame_clear (void *kpage)
+{
+  struct frame *f = lookup_frame (kpage);
+
+  if (f == NULL)
+    return;
+
+  frame_lock ();
+  list_init (&f->maps);
+  f->pin_cnt = 0;
+  f->cached = false;
+  frame_unlock ();
+}
+
+/* Keeps KPAGE from being evicted until frame_unpin(). */
+void
+frame_pin (void *kpage)
+{
+  struct frame *f = lookup_frame (kpage);
+
+  if (f == NULL)
+    return;
+
+  frame_lock ();
+  f->pin_cnt++;
+  frame_unlock ();
+}
+
+/* Undoes one frame_pin() of KPAGE. */
+void
+frame_unpin (void *kpage)
+{
+  struct frame *f = lookup_frame (kpage);
+
+  if (f == NULL)
+    return;
+
+  frame_lock ();
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  frame_unlock ();
+}
+
+/* Marks KPAGE as a page cache frame.  On eviction it is handed
+   back to the page cache instead of being swapped out. */
+void
+frame_set_cached (void *kpage)
+{
+  struct frame *f = lookup_frame (kpage);
+
+  if (f == NULL)
+    return;
+
+  frame_lock ();
+  f->cached = true;
+  frame_unlock ();
+}
+
+/* Picks a victim with the clock algorithm, unmaps it and returns
+   its frame to the user pool.  Returns false if no frame could
+   be evicted. */
+bool
+frame_evict (void)
+{
+  bool evicted = false;
+
+  frame_lock ();
+  for (size_t i = 0; i < 2 * frame_cnt; i++)
+    {
+      struct frame *f = &frames[clock_hand];
+      clock_hand = (clock_hand + 1) % frame_cnt;
+
+      if ((list_empty (&f->maps) && !f->cached) || f->pin_cnt > 0)
+        continue;
+
+      if (frame_accessed (f))
+        continue;
+
+      /* Give dirty frames one more lap. */
+      if (i < frame_cnt && frame_dirty (f))
+        continue;
+
+      if (evict_frame (f))
+        {
+          evicted = true;
+          break;
+        }
+    }
+  frame_unlock ();
+
+  return evicted;
+}
+
+/* Returns the number of frames in the table. */
+size_t
+frame_count (void)
+{
+  return frame_cnt;
+}
+
+/* Returns the kernel virtual address of frame IDX. */
+void *
+frame_at (size_t idx)
+{
+  ASSERT (idx < frame_cnt);
+  return frame_page (&frames[idx]);
+}
+
+/* Returns true if user frame KPAGE is mapped, not pinned, and
+   holds private memory that belongs to no file, so that it may be
+   shared copy-on-write with any frame of the same contents.  The
+   frame table lock must be held for the answer to stay true. */
+bool
+frame_is_anonymous (void *kpage)
+{
+  struct frame *f = lookup_frame (kpage);
+  struct list_elem *e;
+
+  if (f == NULL || list_empty (&f->maps) || f->pin_cnt > 0 || f->cached)
+    return false;
+
+  for (e = list_begin (&f->maps); e != list_end (&f->maps); e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->type == PAGE_FILE)
+      return false;
+  return true;
+}
+
+/* Makes every mapping of user frame KPAGE read-only.  The first
+   write through a writable page will be handled by
+   page_copy_on_write(). */
+void
+frame_write_protect (void *kpage)
+{
+  struct frame *f = lookup_frame (kpage);
+  struct list_elem *e;
+
+  if (f == NULL)
+    return;
+
+  frame_lock ();
+  for (e = list_begin (&f->maps); e != list_end (&f->maps); e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      pagedir_set_writable (p->pd, p->upage, false);
+    }
+  frame_unlock ();
+}
+
+/* Undoes frame_write_protect() of user frame KPAGE if it has
+   a single mapping and that page is writable.  A frame mapped
+   more than once stays read-only, to be copied on write. */
+void
+frame_write_unprotect (void *kpage)
+{
+  struct frame *f = lookup_frame (kpage);
+  struct page *p;
+
+  if (f == NULL)
+    return;
+
+  frame_lock ();
+  if (list_size (&f->maps) == 1)
+    {
+      p = list_entry (list_front (&f->maps), struct page, frame_elem);
+      if (p->writable)
+        pagedir_set_writable (p->pd, p->upage, true);
+    }
+  frame_unlock ();
+}
+
+/* Moves every mapping of user frame KPAGE to INTO, which must
+   hold the same contents, read-only, and frees KPAGE.  INTO may
+   also be a frame outside the user pool, such as the zero page.
+   The frame table lock must be held. */
+void
+frame_merge (void *kpage, void *into)
+{
+  struct frame *f = lookup_frame (kpage);
+
+  ASSERT (f != NULL);
+  ASSERT (kpage != into);
+
+  while (!list_empty (&f->maps))
+    {
+      struct page *p = list_entry (list_pop_front (&f->maps), struct page,
+                                   frame_elem);
+
+      pagedir_clear_page (p->pd, p->upage);
+      pagedir_set_page (p->pd, p->upage, into, false);
+      p->kpage = into;
+      frame_map (into, p);
+    }
+  palloc_free_page (kpage);
+}
+
+/* Returns the frame table entry for KPAGE, or a null pointer if
+   KPAGE is not a user frame. */
+static struct frame *
+lookup_frame (void *kpage)
+{
+  size_t idx;
+
+  ASSERT (pg_ofs (kpage) == 0);
+  if (frames == NULL || (uint8_t *) kpage < frame_base)
+    return NULL;
+
+  idx = pg_no (kpage) - pg_no (frame_base);
+  return idx < frame_cnt ? &frames[idx] : NULL;
+}
+
+/* Returns the kernel virtual address of frame F. */
+static void *
+frame_page (struct frame *f)
+{
+  return frame_base + (f - frames) * PGSIZE;
+}
+
+/* Returns true if F was accessed through any of its mappings,
+   clearing the accessed bits on the way. */
+static bool
+frame_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->maps); e != list_end (&f->maps); e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_accessed (p->pd, p->upage))
+        {
+          pagedir_set_accessed (p->pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Returns true if F was written through any of its mappings. */
+static bool
+frame_dirty (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->maps); e != list_end (&f->maps); e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_dirty (p->pd, p->upage))
+        return true;
+    }
+  return false;
+}
+
+/* Unmaps F from every page directory and frees it.  Clean page
+   cache frames and file pages are simply dropped, since they can
+   be read back from their file, and dirty pages of shared
+   mappings are written back to it; anything else goes to swap.
+   Returns false, leaving F alone, if F needs writing back but the
+   I/O lock is busy, or needs swap but no swap slot is free.
+
+   A frame shared copy-on-write after fork() is written to swap
+   once, and every page that maps it refers to the same swap
+   slot.
+
+   A frame that goes to swap takes the frames of the following
+   idle pages of the same process along, so that they are written
+   to adjacent swap slots with one request and can later be read
+   back together by page_load(). */
+static bool
+evict_frame (struct frame *f)
+{
+  struct frame *cluster[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  struct list_elem *e;
+  size_t cnt, slot;
+
+  if (f->cached)
+    {
+      void *kpage = frame_page (f);
+      bool dirty = frame_dirty (f) || pcache_is_dirty (kpage);
+
+      /* See evict_to_file() on taking the I/O lock. */
+      if (dirty && !user_io_try_block ())
+        return false;
+      for (e = list_begin (&f->maps); e != list_end (&f->maps);
+           e = list_next (e))
+        page_drop (list_entry (e, struct page, frame_elem));
+      pcache_evict (kpage, dirty);
+      if (dirty)
+        user_io_release ();
+      return true;
+    }
+  if (evict_to_file (f))
+    {
+      palloc_free_page (frame_page (f));
+      return true;
+    }
+
+  /* Settle for a shorter cluster if swap is fragmented. */
+  cnt = gather_cluster (f, cluster);
+  while ((slot = swap_alloc_multiple (cnt)) == BITMAP_ERROR)
+    {
+      if (cnt == 1)
+        return false;
+      cnt /= 2;
+    }
+
+  /* Unmap the pages before writing them out, so that nobody can
+     change them behind our back.  Anyone who faults on them
+     waits for the frame table lock, and so for the write. */
+  for (size_t i = 0; i < cnt; i++)
+    {
+      struct list *maps = &cluster[i]->maps;
+
+      kpages[i] = frame_page (cluster[i]);
+      for (e = list_begin (maps); e != list_end (maps); e = list_next (e))
+        {
+          if (e != list_begin (maps))
+            swap_dup_page (slot + i);
+          page_save_to_swap (list_entry (e, struct page, frame_elem),
+                             slot + i);
+        }
+    }
+  swap_write_multiple (slot, kpages, cnt);
+  for (size_t i = 0; i < cnt; i++)
+    palloc_free_page (kpages[i]);
+  return true;
+}
+
+/* Unmaps F if it can be read back from a file later: if every
+   page that maps it is a file page and F is clean, or F is the
+   dirty page of a single shared mapping, which is written back
+   to its file first.  Returns false, leaving F alone, if F must
+   go to swap instead. */
+static bool
+evict_to_file (struct frame *f)
+{
+  struct list_elem *e;
+  struct page *p = NULL;
+  bool dirty = false;
+
+  for (e = list_begin (&f->maps); e != list_end (&f->maps); e = list_next (e))
+    {
+      p = list_entry (e, struct page, frame_elem);
+      if (p->type != PAGE_FILE)
+        return false;
+      dirty = dirty || p->dirty || pagedir_is_dirty (p->pd, p->upage);
+    }
+
+  /* Writing back takes the I/O lock, which must not be waited
+     for with the frame table lock held: whoever holds it may be
+     faulting right now. */
+  if (dirty && (list_size (&f->maps) != 1 || !p->shared
+                || !user_io_try_block ()))
+    return false;
+
+  for (e = list_begin (&f->maps); e != list_end (&f->maps); e = list_next (e))
+    page_drop (list_entry (e, struct page, frame_elem));
+  if (dirty)
+    {
+      mmap_write_back (p->file, p->ofs, frame_page (f), p->read_bytes);
+      p->dirty = false;
+      user_io_release ();
+    }
+  return true;
+}
+
+/* Fills CLUSTER with F followed by the frames of the pages that
+   follow F's page in the same process, stopping at the first one
+   that is not present, recently accessed, pinned, shared, cached
+   or backed by a file.  Returns the number of frames in CLUSTER. */
+static size_t
+gather_cluster (struct frame *f, struct frame *cluster[SWAP_CLUSTER])
+{
+  struct page *p;
+  uint8_t *upage;
+  size_t cnt = 1;
+
+  cluster[0] = f;
+  if (list_size (&f->maps) != 1)
+    return cnt;
+
+  p = list_entry (list_front (&f->maps), struct page, frame_elem);
+  for (upage = (uint8_t *) p->upage + PGSIZE;
+       cnt < SWAP_CLUSTER && is_user_vaddr (upage);
+       upage += PGSIZE)
+    {
+      void *kpage = pagedir_get_page (p->pd, upage);
+      struct frame *g = kpage != NULL ? lookup_frame (kpage) : NULL;
+
+      if (g == NULL || g->cached || g->pin_cnt > 0
+          || list_size (&g->maps) != 1
+          || pagedir_is_accessed (p->pd, upage)
+          || list_entry (list_front (&g->maps), struct page,
+                         frame_elem)->type == PAGE_FILE)
+        break;
+      cluster[cnt++] = g;
+    }
+  return cnt;
+}
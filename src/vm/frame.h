@@ -0,0 +1,32 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void frame_init   (void *base, size_t page_cnt);
+
+void frame_lock   (void);
+void frame_unlock (void);
+
+struct page;
+
+void frame_map    (void *kpage, struct page *);
+bool frame_unmap  (void *kpage, struct page *);
+bool frame_is_shared (void *kpage);
+bool frame_clean  (void *kpage);
+void frame_clear  (void *kpage);
+void frame_pin    (void *kpage);
+void frame_unpin  (void *kpage);
+void frame_set_cached (void *kpage);
+bool frame_evict  (void);
+
+size_t frame_count (void);
+void *frame_at    (size_t idx);
+bool frame_is_anonymous (void *kpage);
+void frame_write_protect (void *kpage);
+void frame_write_unprotect (void *kpage);
+void frame_merge  (void *kpage, void *into);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,204 @@
+#include "vm/ksm.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Same-page merging.
+
+   A low-priority kernel thread looks for user frames that have
+   identical contents, in the same process or in different ones.
+   It merges them into one frame that all of their pages map
+   read-only.  The first write through any of those pages gets
+   its own copy from page_copy_on_write(), just as after fork(),
+   so pages are unmerged only as fast as they are written.
+
+   The thread walks the frame table SCAN_CNT frames at a time and
+   sleeps SLEEP_MS milliseconds between batches; together these
+   set the merge rate.  Only anonymous frames are considered (see
+   frame_is_anonymous()).  A frame is merged only if its checksum
+   is the same on two passes in a row, so that pages still being
+   written are left alone.  Frames of all zeros go to the shared
+   zero page.  Other frames are matched through a hash table that
+   maps each checksum to the last frame seen with it.  The table
+   is rebuilt on every pass over the frame table.
+
+   Frames that look the same are compared again after all of
+   their mappings are write-protected.  From then on, any write
+   faults and waits for the frame table lock, which is held until
+   the merge is done.  Frames that turn out to differ get their
+   write access back, so that pages the scanner rejects do not
+   take a fault on their next write. */
+
+/* A frame seen during the current pass. */
+struct ksm_node
+  {
+    unsigned sum;                       /* Checksum of contents. */
+    void *kpage;                        /* Frame. */
+    struct hash_elem elem;              /* Element in `nodes'. */
+  };
+
+static size_t scan_cnt;                 /* Frames per batch. */
+static unsigned sleep_ms;               /* Pause between batches. */
+static unsigned *sums;                  /* Last checksum of each frame. */
+static size_t cursor;                   /* Next frame to scan. */
+static struct hash nodes;               /* Frames by checksum. */
+static unsigned zero_sum;               /* Checksum of a page of zeros. */
+static size_t merge_cnt;                /* Frames merged so far. */
+
+static thread_func ksm_daemon NO_RETURN;
+static void scan_frame (size_t idx);
+static bool try_merge (void *kpage, void *into);
+static hash_hash_func node_hash;
+static hash_less_func node_less;
+static hash_action_func free_node;
+
+/* Starts the same-page merging thread, which examines SCAN_CNT_
+   frames every SLEEP_MS_ milliseconds. */
+void
+ksm_init (size_t scan_cnt_, unsigned sleep_ms_)
+{
+  size_t sum_pages = DIV_ROUND_UP (frame_count () * sizeof *sums, PGSIZE);
+
+  ASSERT (scan_cnt_ > 0);
+
+  scan_cnt = scan_cnt_;
+  sleep_ms = sleep_ms_;
+  sums = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, sum_pages);
+  cursor = 0;
+  hash_init (&nodes, node_hash, node_less, NULL);
+  zero_sum = hash_bytes (page_zero_frame (), PGSIZE);
+
+  if (thread_create ("ksm", PRI_MIN, ksm_daemon, NULL) == TID_ERROR)
+    PANIC ("Couldn't start same-page merging thread");
+  printf ("ksm: scanning %zu frames every %u ms.\n", scan_cnt, sleep_ms);
+}
+
+/* Prints same-page merging statistics, if the thread runs. */
+void
+ksm_print_stats (void)
+{
+  if (sums != NULL)
+    printf ("KSM: %zu frames merged\n", merge_cnt);
+}
+
+/* Scans the frame table, one batch at a time. */
+static void
+ksm_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      for (size_t i = 0; i < scan_cnt; i++)
+        {
+          scan_frame (cursor);
+          if (++cursor == frame_count ())
+            {
+              cursor = 0;
+              hash_clear (&nodes, free_node);
+            }
+        }
+      timer_msleep (sleep_ms);
+    }
+}
+
+/* Examines frame IDX and merges it into a frame with the same
+   contents, if one has been seen. */
+static void
+scan_frame (size_t idx)
+{
+  void *kpage = frame_at (idx);
+  struct ksm_node key, *node;
+  struct hash_elem *e;
+  unsigned sum;
+
+  frame_lock ();
+  if (!frame_is_anonymous (kpage))
+    goto done;
+
+  /* Wait for a second pass to see whether the page is stable. */
+  sum = hash_bytes (kpage, PGSIZE);
+  if (sum != sums[idx])
+    {
+      sums[idx] = sum;
+      goto done;
+    }
+
+  if (sum == zero_sum && try_merge (kpage, page_zero_frame ()))
+    goto done;
+
+  key.sum = sum;
+  e = hash_find (&nodes, &key.elem);
+  if (e != NULL)
+    {
+      node = hash_entry (e, struct ksm_node, elem);
+      if (node->kpage == kpage
+          || (frame_is_anonymous (node->kpage)
+              && try_merge (kpage, node->kpage)))
+        goto done;
+
+      /* A checksum collision, or the frame has changed or gone
+         since.  Remember the newer one. */
+      node->kpage = kpage;
+    }
+  else if ((node = malloc (sizeof *node)) != NULL)
+    {
+      node->sum = sum;
+      node->kpage = kpage;
+      hash_insert (&nodes, &node->elem);
+    }
+
+ done:
+  frame_unlock ();
+}
+
+/* Merges frame KPAGE into INTO if their contents are the same.
+   Returns true if successful.  The frame table lock must be
+   held. */
+static bool
+try_merge (void *kpage, void *into)
+{
+  if (memcmp (kpage, into, PGSIZE))
+    return false;
+
+  /* Compare again once nobody can write to either frame. */
+  frame_write_protect (kpage);
+  frame_write_protect (into);
+  if (memcmp (kpage, into, PGSIZE))
+    {
+      frame_write_unprotect (kpage);
+      frame_write_unprotect (into);
+      return false;
+    }
+
+  frame_merge (kpage, into);
+  merge_cnt++;
+  return true;
+}
+
+static unsigned
+node_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry (e, struct ksm_node, elem)->sum;
+}
+
+static bool
+node_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return (hash_entry (a, struct ksm_node, elem)->sum
+          < hash_entry (b, struct ksm_node, elem)->sum);
+}
+
+static void
+free_node (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct ksm_node, elem));
+}
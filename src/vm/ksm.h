@@ -0,0 +1,9 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+
+#include <stddef.h>
+
+void ksm_init (size_t scan_cnt, unsigned sleep_ms);
+void ksm_print_stats (void);
+
+#endif /* vm/ksm.h */
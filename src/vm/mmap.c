@@ -1,33 +1,55 @@
 #include "vm/mmap.h"
 #include <debug.h>
-#include <list.h>
+#include <rbtree.h>
 #include <round.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <syscall-nr.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
-#include "userprog/pagedir.h"
 #include "userprog/user-io.h"
+#include "vm/page.h"
 
 struct mmap
 {
   mapid_t          id;
-  struct file     *file;
+  struct file     *file;     /* Null for zeroed memory */
   uint8_t         *base;
-  struct list_elem elem;
+  off_t            ofs;      /* File offset mapped at BASE */
+  size_t           length;   /* Bytes of FILE mapped */
+  bool             private;  /* Executable segment, never written back */
+  bool             writable; /* Writable by the user process */
+  struct rb_elem   addr_elem; /* Element in thread's mmaps */
+  struct rb_elem   id_elem;   /* Element in thread's mmap_ids */
 };
 
+/* If true, executables are read in completely when they are
+   loaded, instead of page by page as they are first touched.
+   Controlled by kernel command-line option "-prefault". */
+bool mmap_prefault_exec;
 
+/* A process's mappings are kept in two red-black trees: `mmaps'
+   orders them by address, which makes it an interval tree since
+   mappings never overlap, and `mmap_ids' by id.  Checking a new
+   mapping for overlap and looking up a mapping to unmap take
+   O(log n) time. */
 
 /* Internal function prototypes */
 static mapid_t get_mapid (void);
 static struct mmap *alloc_mmap (void);
+static void add_mmap (struct thread *, struct mmap *);
 static void free_mmap (struct mmap *mmap);
 static struct mmap *find_mmap (mapid_t mid);
+static bool overlaps (const void *addr, size_t length);
+static bool is_user_range (const void *addr, size_t length);
+static uint8_t *mmap_ceiling (void);
+static void *find_free_range (size_t length);
+static rb_less_func mmap_addr_less;
+static rb_less_func mmap_id_less;
 
 
 /* internal functions */
@@ -50,54 +72,151 @@ alloc_mmap (void)
   return mmap;
 }
 
+static void
+add_mmap (struct thread *t, struct mmap *mmap)
+{
+  rb_insert (&t->mmaps, &mmap->addr_elem);
+  rb_insert (&t->mmap_ids, &mmap->id_elem);
+}
+
 static void
 free_mmap (struct mmap *mmap)
 {
   struct thread *t = thread_current ();
-  size_t _fsize = file_length (mmap->file);
+  size_t _fsize = mmap->length;
 
   size_t fsize = _fsize;
   for (uint8_t *page = mmap->base;
-       (size_t) (page - mmap->base) < ROUND_UP (_fsize, PGSIZE);
+       mmap->file != NULL && !mmap->private && (size_t) (page - mmap->base) < ROUND_UP (_fsize, PGSIZE);
        page += PGSIZE, fsize -= PGSIZE)
     {
-      if (pagedir_is_dirty (t->pagedir, page))
+      if (page_is_dirty (page))
         {
-          file_seek  (mmap->file, page - mmap->base);
+          file_seek  (mmap->file, mmap->ofs + (page - mmap->base));
           file_write (mmap->file, page, (fsize < PGSIZE) ? fsize : PGSIZE);
         }
     }
-  pagedir_clear_mmap (t->pagedir, mmap->base, _fsize);
+  page_remove_range (mmap->base, _fsize);
   file_close (mmap->file);
-  list_remove (&mmap->elem);
+  rb_remove (&t->mmaps, &mmap->addr_elem);
+  rb_remove (&t->mmap_ids, &mmap->id_elem);
   free (mmap);
 }
 
 static struct mmap *
 find_mmap (mapid_t mid)
 {
-  struct thread    *t = thread_current ();
-  struct list_elem *e;
-  for (e = list_begin (&t->mmap);
-       e != list_end (&t->mmap);
-       e = list_next (e))
+  struct mmap      key;
+  struct rb_elem  *e;
+
+  key.id = mid;
+  e = rb_find (&thread_current ()->mmap_ids, &key.id_elem);
+  return e != NULL ? rb_entry (e, struct mmap, id_elem) : NULL;
+}
+
+/* Returns true if LENGTH bytes at ADDR overlap an existing
+   mapping of the current process.  The only candidate is the
+   last mapping that starts before the end of the range. */
+static bool
+overlaps (const void *addr, size_t length)
+{
+  struct mmap      key;
+  struct rb_elem  *e;
+  struct mmap     *mmap;
+
+  key.base = (uint8_t *) addr + ROUND_UP (length, PGSIZE) - 1;
+  e = rb_floor (&thread_current ()->mmaps, &key.addr_elem);
+  if (e == NULL)
+    return false;
+  mmap = rb_entry (e, struct mmap, addr_elem);
+  return mmap->base + ROUND_UP (mmap->length, PGSIZE) > (uint8_t *) addr;
+}
+
+/* Returns true if LENGTH bytes at ADDR, which must be
+   page-aligned, lie in user space. */
+static bool
+is_user_range (const void *addr, size_t length)
+{
+  return (pg_ofs (addr) == 0 && is_user_vaddr (addr)
+          && length <= (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr));
+}
+
+/* Returns the end of the address space that mappings and the
+   heap may use: the bottom of the current process's stack area,
+   less a guard gap that catches stack overflows. */
+static uint8_t *
+mmap_ceiling (void)
+{
+  size_t reserved = thread_current ()->stack_limit + STACK_GUARD_SIZE;
+
+  if (reserved > (size_t) PHYS_BASE)
+    return NULL;
+  return (uint8_t *) PHYS_BASE - ROUND_UP (reserved, PGSIZE);
+}
+
+/* Returns the highest address below the stack area at which
+   LENGTH bytes, a multiple of PGSIZE, fit between the current
+   process's mappings and above its heap, or a null pointer if
+   there is none. */
+static void *
+find_free_range (size_t length)
+{
+  struct thread   *t   = thread_current ();
+  uint8_t         *top = mmap_ceiling ();
+  struct rb_elem  *e;
+
+  for (e = rb_max (&t->mmaps); e != NULL; e = rb_prev (e))
     {
-      struct mmap *mmap = list_entry (e, struct mmap, elem);
+      struct mmap *mmap = rb_entry (e, struct mmap, addr_elem);
+      uint8_t *end = mmap->base + ROUND_UP (mmap->length, PGSIZE);
 
-      if (mmap->id == mid)
-        return mmap;
+      if (end <= top && (size_t) (top - end) >= length)
+        break;
+      if (mmap->base < top)
+        top = mmap->base;
     }
 
-  return NULL;
+  if (top < (uint8_t *) pg_round_up (t->heap_brk)
+      || (size_t) (top - (uint8_t *) pg_round_up (t->heap_brk)) < length)
+    return NULL;
+  return top - length;
+}
+
+static bool
+mmap_addr_less (const struct rb_elem *a, const struct rb_elem *b,
+                void *aux UNUSED)
+{
+  return (rb_entry (a, struct mmap, addr_elem)->base
+          < rb_entry (b, struct mmap, addr_elem)->base);
+}
+
+static bool
+mmap_id_less (const struct rb_elem *a, const struct rb_elem *b,
+              void *aux UNUSED)
+{
+  return (rb_entry (a, struct mmap, id_elem)->id
+          < rb_entry (b, struct mmap, id_elem)->id);
 }
 
 
 
 /* External functions */
 
-/* TODO */
+/* Initializes the mapping trees of T. */
+void
+mmap_table_init (struct thread *t)
+{
+  rb_init (&t->mmaps, mmap_addr_less, NULL);
+  rb_init (&t->mmap_ids, mmap_id_less, NULL);
+}
+
+
+/* Maps FILE at ADDR and returns the id of the mapping, or -1
+   on failure.  FLAGS may include MAP_POPULATE, which reads the
+   whole file in now instead of a page at a time as it is first
+   touched. */
 mapid_t
-mmap (struct file *file, void *addr)
+mmap (struct file *file, void *addr, int flags)
 {
   struct thread *t      = thread_current ();
   struct mmap   *mmap;
@@ -106,41 +225,235 @@ mmap (struct file *file, void *addr)
   if (addr == NULL)
     return -1; /* PintOS requirement */
 
+  if ((flags & ~MAP_POPULATE) != 0)
+    return -1;
+
   if ((fsize = file_length (file)) == 0)
     return -1;
 
+  if (!is_user_range (addr, ROUND_UP (fsize, PGSIZE))
+      || (uint8_t *) addr + ROUND_UP (fsize, PGSIZE) > mmap_ceiling ()
+      || overlaps (addr, fsize))
+    return -1;
+
   if ((mmap = alloc_mmap ()) == NULL)
     return -1;
 
-  if (!pagedir_setup_mmap (t->pagedir, addr, mmap->id, fsize))
+  if ((mmap->file = file_reopen (file)) == NULL)
     {
       free (mmap);
       return -1;
     }
 
+  if (!page_add_file (addr, mmap->file, 0, fsize, true, true))
+    {
+      file_close (mmap->file);
+      free (mmap);
+      return -1;
+    }
+
   mmap->base     = addr;
-  mmap->file     = file_reopen (file);
-  list_push_back (&t->mmap, &mmap->elem);
+  mmap->ofs      = 0;
+  mmap->length   = fsize;
+  mmap->private  = false;
+  mmap->writable = true;
+  add_mmap (t, mmap);
+
+  if (flags & MAP_POPULATE)
+    page_populate_range (addr, fsize);
 
   return mmap->id;
 }
 
-/* TODO */
+/* Maps LENGTH bytes of zeroed memory at ADDR, which must be
+   page-aligned, or wherever it fits below the stack if ADDR is
+   null.  The pages are only allocated when first touched.
+   Returns the address of the mapping, or a null pointer on
+   failure. */
+void *
+mmap_anon (void *addr, size_t length)
+{
+  struct thread *t = thread_current ();
+  struct mmap   *mmap;
+
+  if (length == 0 || length > (size_t) PHYS_BASE)
+    return NULL;
+  length = ROUND_UP (length, PGSIZE);
+
+  if (addr == NULL && (addr = find_free_range (length)) == NULL)
+    return NULL;
+
+  if (!is_user_range (addr, length) || overlaps (addr, length)
+      || (uint8_t *) addr + length > mmap_ceiling ())
+    return NULL;
+
+  if ((mmap = alloc_mmap ()) == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < length; i += PGSIZE)
+    if (!page_add_zero ((uint8_t *) addr + i, true))
+      {
+        page_remove_range (addr, i);
+        free (mmap);
+        return NULL;
+      }
+
+  mmap->file     = NULL;
+  mmap->base     = addr;
+  mmap->ofs      = 0;
+  mmap->length   = length;
+  mmap->private  = false;
+  mmap->writable = true;
+  add_mmap (t, mmap);
+
+  return addr;
+}
+
+/* Removes the mapping of zeroed memory made by mmap_anon() at
+   ADDR, if there is one. */
+void
+munmap_anon (void *addr)
+{
+  struct mmap      key;
+  struct rb_elem  *e;
+  struct mmap     *mmap;
+
+  key.base = addr;
+  e = rb_find (&thread_current ()->mmaps, &key.addr_elem);
+  if (e == NULL)
+    return;
+
+  mmap = rb_entry (e, struct mmap, addr_elem);
+  if (mmap->file == NULL)
+    free_mmap (mmap);
+}
+
+/* Moves the current process's program break INCREMENT bytes.
+   Pages the heap grows into start out zeroed and are allocated
+   when first touched; pages it shrinks out of are freed.
+   Returns the previous break, or a null pointer if the heap
+   would run into a mapping or the stack area, or below its
+   start. */
+void *
+mmap_sbrk (intptr_t increment)
+{
+  struct thread *t   = thread_current ();
+  uint8_t       *old = t->heap_brk;
+  uint8_t       *new = old + increment;
+  uint8_t       *old_top = pg_round_up (old);
+  uint8_t       *new_top;
+
+  if (increment < 0
+      ? (size_t) -increment > (size_t) (old - t->heap_base)
+      : old > mmap_ceiling ()
+        || (size_t) increment > (size_t) (mmap_ceiling () - old))
+    return NULL;
+
+  new_top = pg_round_up (new);
+  if (new_top > old_top)
+    {
+      if (overlaps (old_top, new_top - old_top))
+        return NULL;
+      for (uint8_t *page = old_top; page < new_top; page += PGSIZE)
+        if (!page_add_zero (page, true))
+          {
+            page_remove_range (old_top, page - old_top);
+            return NULL;
+          }
+    }
+  else if (new_top < old_top)
+    page_remove_range (new_top, old_top - new_top);
+
+  t->heap_brk = new;
+  return old;
+}
+
+/* Maps READ_BYTES bytes of FILE, starting at offset OFS, at
+   UPAGE as a private executable segment.  Pages are read in on
+   first access by the page fault handler and are never written
+   back to FILE.  Returns true if successful. */
 bool
-mmap_load_page (mapid_t mid, void *page)
+mmap_segment (struct file *file, off_t ofs, void *upage,
+              size_t read_bytes, bool writable)
 {
-  struct mmap *mmap;
+  struct thread *t = thread_current ();
+  struct mmap   *mmap;
 
-  if ((mmap = find_mmap(mid)) == NULL)
+  ASSERT (read_bytes > 0);
+
+  if (overlaps (upage, read_bytes))
+    return false;
+
+  if ((mmap = alloc_mmap ()) == NULL)
     return false;
 
-  user_io_block ();
-  file_seek (mmap->file, (uint8_t *)page - mmap->base);
-  file_read (mmap->file, page, PGSIZE);
-  user_io_release ();
+  if ((mmap->file = file_reopen (file)) == NULL)
+    {
+      free (mmap);
+      return false;
+    }
+
+  if (!page_add_file (upage, mmap->file, ofs, read_bytes, writable, false))
+    {
+      file_close (mmap->file);
+      free (mmap);
+      return false;
+    }
+
+  mmap->base     = upage;
+  mmap->ofs      = ofs;
+  mmap->length   = read_bytes;
+  mmap->private  = true;
+  mmap->writable = writable;
+  add_mmap (t, mmap);
+
+  return true;
+}
+
+/* Writes the first LENGTH bytes of KPAGE, the frame of a page of
+   a shared mapping of FILE at offset OFS, back to the file.  Used
+   when the page is evicted.  The caller must hold the I/O lock. */
+void
+mmap_write_back (struct file *file, off_t ofs, const void *kpage,
+                 size_t length)
+{
+  file_write_at (file, kpage, length, ofs);
+}
+
+/* Gives the current thread a copy of every mapping of PARENT,
+   under the same ids, for fork().  The page table entries are
+   copied separately by page_table_fork().  Returns false if out of
+   memory. */
+bool
+mmap_fork (struct thread *parent)
+{
+  struct thread    *t = thread_current ();
+  struct rb_elem   *e;
+
+  for (e = rb_min (&parent->mmaps); e != NULL; e = rb_next (e))
+    {
+      struct mmap *pmmap = rb_entry (e, struct mmap, addr_elem);
+      struct mmap *mmap  = malloc (sizeof (struct mmap));
+
+      if (mmap == NULL)
+        return false;
+
+      *mmap = *pmmap;
+      if (pmmap->file != NULL)
+        {
+          user_io_block ();
+          mmap->file = file_reopen (pmmap->file);
+          user_io_release ();
+          if (mmap->file == NULL)
+            {
+              free (mmap);
+              return false;
+            }
+          page_set_file (mmap->base, mmap->length, mmap->file);
+        }
+      add_mmap (t, mmap);
+    }
 
-  /* Dirty bits are used to check file write */
-  pagedir_set_dirty (thread_current ()->pagedir, page, false);
   return true;
 }
 
@@ -150,22 +463,71 @@ munmap (mapid_t mid)
 {
   struct mmap *mmap;
 
-  if ((mmap = find_mmap(mid)) == NULL)
+  if ((mmap = find_mmap(mid)) == NULL || mmap->private)
     return;
 
   free_mmap (mmap);
 }
 
+/* Writes the pages among LENGTH bytes at ADDR that belong to
+   shared mappings and have been written to back to their files.
+   Returns false if the range is not page-aligned user memory. */
+bool
+mmap_sync (void *addr, size_t length)
+{
+  if (!is_user_range (addr, length))
+    return false;
+
+  page_sync_range (addr, length);
+  return true;
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the pages among
+   LENGTH bytes at ADDR:
+
+     - MADV_NORMAL and MADV_SEQUENTIAL turn read-ahead on faults
+       in file mappings off and on.
+
+     - MADV_WILLNEED reads the pages in now.
+
+     - MADV_DONTNEED drops the pages from memory now.
+
+   Returns false if the range is not page-aligned user memory or
+   ADVICE is unknown. */
+bool
+mmap_advise (void *addr, size_t length, int advice)
+{
+  if (!is_user_range (addr, length))
+    return false;
+
+  switch (advice)
+    {
+    case MADV_NORMAL:
+    case MADV_SEQUENTIAL:
+      page_set_sequential (addr, length, advice == MADV_SEQUENTIAL);
+      return true;
+    case MADV_WILLNEED:
+      for (size_t i = 0; i < length; i += PGSIZE)
+        page_load ((uint8_t *) addr + i, false);
+      return true;
+    case MADV_DONTNEED:
+      page_discard_range (addr, length);
+      return true;
+    default:
+      return false;
+    }
+}
+
 void
 mmap_close_all (void)
 {
   struct thread *t = thread_current ();
 
-  struct list_elem *e = list_begin (&t->mmap);
-  while (e != list_end (&t->mmap))
+  struct rb_elem *e = rb_min (&t->mmaps);
+  while (e != NULL)
     {
-      struct list_elem *next = list_next (e);
-      struct mmap *mmap = list_entry (e, struct mmap, elem);
+      struct rb_elem *next = rb_next (e);
+      struct mmap *mmap = rb_entry (e, struct mmap, addr_elem);
 
       user_io_block ();
       free_mmap (mmap);
@@ -2,13 +2,28 @@
 #define VM_MMAP_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "filesys/file.h"
+#include "threads/thread.h"
 
 typedef int mapid_t;
 
-mapid_t mmap           (struct file *, void *addr);
+extern bool mmap_prefault_exec;
+
+void    mmap_table_init (struct thread *);
+mapid_t mmap           (struct file *, void *addr, int flags);
+bool    mmap_segment   (struct file *, off_t ofs, void *upage,
+                        size_t read_bytes, bool writable);
 void    munmap         (mapid_t mid);
-bool    mmap_load_page (mapid_t mid, void *page);
+void   *mmap_anon      (void *addr, size_t length);
+void    munmap_anon    (void *addr);
+void   *mmap_sbrk      (intptr_t increment);
+bool    mmap_sync      (void *addr, size_t length);
+bool    mmap_advise    (void *addr, size_t length, int advice);
+bool    mmap_fork      (struct thread *parent);
+void    mmap_write_back (struct file *, off_t ofs, const void *kpage,
+                         size_t length);
 void    mmap_close_all (void);
 
 #endif /* VM_MMAP_H */
@@ -0,0 +1,748 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/user-io.h"
+#include "vm/frame.h"
+#include "vm/pcache.h"
+#include "vm/swap-alloc.h"
+
+/* Supplemental page table.
+
+   Every user page a process may touch has an entry in its
+   thread's `pages' hash, keyed by user virtual address, telling
+   where the page's contents are while it is not in memory.  The
+   hardware page table only ever holds present pages; a page
+   fault on any other page is resolved by looking up its entry.
+
+   The table itself is only changed by its owner, but the frame
+   table evicts pages of any process.  Fields that describe
+   whether and where a page is present are therefore protected by
+   the frame table lock. */
+
+/* Most pages read by one swap-in. */
+#define SWAP_READAHEAD 8
+
+/* Most pages read by one fault on a sequential file mapping. */
+#define FILE_READAHEAD 8
+
+/* A kernel page of zeros, mapped read-only at every blank page
+   that has been read but not yet written.  It lives outside the
+   user pool, so the frame table never sees it. */
+static void *zero_page;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func destroy_page;
+static struct page *page_lookup (const void *upage);
+static struct page *page_create (void *upage, bool writable);
+static void free_page (struct page *);
+static void release_page (struct page *);
+static bool load_page (struct page *, bool write);
+static void read_ahead (struct page *);
+static bool install_page (struct page *, void *kpage);
+static void *load_file_page (struct page *, bool *pinned);
+static bool load_swap_pages (struct page *);
+static size_t gather_readahead (struct page *,
+                                struct page *run[SWAP_READAHEAD],
+                                size_t *pos);
+static struct page *swap_neighbour (struct page *, int distance);
+
+/* Allocates the shared zero page. */
+void
+page_init (void)
+{
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+}
+
+/* Returns the shared zero page. */
+void *
+page_zero_frame (void)
+{
+  return zero_page;
+}
+
+/* Initializes the current thread's supplemental page table.
+   Returns false if memory allocation fails. */
+bool
+page_table_init (void)
+{
+  return hash_init (&thread_current ()->pages, page_hash, page_less, NULL);
+}
+
+/* Frees every page of the current thread, along with its frame
+   or swap slot, and the table itself. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+  struct pagedir_batch batch;
+
+  pagedir_batch_begin (&batch, t->pagedir);
+  frame_lock ();
+  hash_destroy (&t->pages, destroy_page);
+  frame_unlock ();
+  pagedir_batch_end (&batch);
+}
+
+/* Copies the pages of PARENT into the current thread's table
+   and page directory, for fork().  Present pages are not copied:
+   both processes map the same frame read-only, and the first
+   write through either one is given its own copy by
+   page_copy_on_write().  Swap slots and page cache frames are
+   shared outright, the latter writable if they belong to a
+   shared mapping.  Returns false if memory allocation fails. */
+bool
+page_table_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  bool success = true;
+
+  frame_lock ();
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, elem);
+      struct page *p = malloc (sizeof *p);
+
+      if (p == NULL)
+        {
+          success = false;
+          break;
+        }
+      *p = *pp;
+      p->pd = t->pagedir;
+      p->dirty = pp->dirty || pagedir_is_dirty (pp->pd, pp->upage);
+
+      if (p->kpage != NULL)
+        {
+          bool shared = p->cached && p->writable;
+
+          if (!pagedir_set_page (p->pd, p->upage, p->kpage, shared))
+            {
+              free (p);
+              success = false;
+              break;
+            }
+          if (!shared)
+            pagedir_set_writable (pp->pd, pp->upage, false);
+          frame_map (p->kpage, p);
+        }
+      else if (p->type == PAGE_SWAP)
+        swap_dup_page (p->swap_idx);
+      hash_insert (&t->pages, &p->elem);
+    }
+  frame_unlock ();
+
+  return success;
+}
+
+/* Adds a page of zeros at UPAGE to the current process.  Returns
+   false if UPAGE is already in use or memory allocation fails. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return page_create (upage, writable) != NULL;
+}
+
+/* Adds pages at UPAGE holding LENGTH bytes of FILE, starting at
+   offset OFS.  The rest of the last page is zeroed.  Changes to
+   SHARED pages are written back to FILE; private pages that are
+   written go to swap instead.  Shared pages and private
+   read-only pages are shared with other processes through the
+   page cache.  Returns false if any of the pages is already in
+   use or memory allocation fails. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs, size_t length,
+               bool writable, bool shared)
+{
+  uint8_t *base = upage;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  for (size_t i = 0; i < length; i += PGSIZE)
+    if (page_lookup (base + i) != NULL)
+      return false;
+
+  for (size_t i = 0; i < length; i += PGSIZE)
+    {
+      struct page *p = page_create (base + i, writable);
+
+      if (p == NULL)
+        {
+          page_remove_range (base, i);
+          return false;
+        }
+      p->type = PAGE_FILE;
+      p->file = file;
+      p->ofs = ofs + i;
+      p->read_bytes = length - i < PGSIZE ? length - i : PGSIZE;
+      p->shared = shared;
+      p->cached = !writable || shared;
+    }
+  return true;
+}
+
+/* Makes the file pages covering LENGTH bytes at UPAGE refer to
+   FILE, for fork(). */
+void
+page_set_file (void *upage, size_t length, struct file *file)
+{
+  uint8_t *base = upage;
+
+  frame_lock ();
+  for (size_t i = 0; i < length; i += PGSIZE)
+    {
+      struct page *p = page_lookup (base + i);
+      if (p != NULL && p->file != NULL)
+        p->file = file;
+    }
+  frame_unlock ();
+}
+
+/* Removes the pages covering LENGTH bytes at UPAGE from the
+   current process. */
+void
+page_remove_range (void *upage, size_t length)
+{
+  uint8_t *base = upage;
+  struct pagedir_batch batch;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  pagedir_batch_begin (&batch, thread_current ()->pagedir);
+  frame_lock ();
+  for (size_t i = 0; i < length; i += PGSIZE)
+    {
+      struct page *p = page_lookup (base + i);
+      if (p != NULL)
+        {
+          hash_delete (&thread_current ()->pages, &p->elem);
+          free_page (p);
+        }
+    }
+  frame_unlock ();
+  pagedir_batch_end (&batch);
+}
+
+/* Returns true if the page at UPAGE has been written to since it
+   was added.  Pages shared through the page cache are written
+   back by the cache and never reported dirty. */
+bool
+page_is_dirty (const void *upage)
+{
+  struct page *p = page_lookup (upage);
+  bool dirty;
+
+  if (p == NULL || p->cached)
+    return false;
+
+  frame_lock ();
+  dirty = p->dirty || (p->kpage != NULL && pagedir_is_dirty (p->pd, p->upage));
+  frame_unlock ();
+  return dirty;
+}
+
+/* Writes the pages of shared mappings covering LENGTH bytes at
+   UPAGE that have been written to since they were last written
+   back to their files, for msync(), and marks them clean.  The
+   caller must hold the I/O lock. */
+void
+page_sync_range (void *upage, size_t length)
+{
+  uint8_t *base = upage;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  frame_lock ();
+  for (size_t i = 0; i < length; i += PGSIZE)
+    {
+      struct page *p = page_lookup (base + i);
+      bool dirty;
+
+      if (p == NULL || p->kpage == NULL || p->type != PAGE_FILE
+          || !p->shared)
+        continue;
+
+      /* Clear the dirty bits before writing, so that writes made
+         by other processes meanwhile are not lost. */
+      dirty = frame_clean (p->kpage);
+      if (p->cached)
+        pcache_sync (p->kpage, dirty);
+      else if (dirty || p->dirty)
+        {
+          file_write_at (p->file, p->kpage, p->read_bytes, p->ofs);
+          p->dirty = false;
+        }
+    }
+  frame_unlock ();
+}
+
+/* Drops the pages covering LENGTH bytes at UPAGE from memory at
+   once, for madvise().  Pages of shared mappings are written back
+   and will be read in again from their files.  Any other page
+   loses what was written to it, going back to the contents of its
+   file or to zeros.  The caller must hold the I/O lock. */
+void
+page_discard_range (void *upage, size_t length)
+{
+  uint8_t *base = upage;
+  struct pagedir_batch batch;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  pagedir_batch_begin (&batch, thread_current ()->pagedir);
+  frame_lock ();
+  for (size_t i = 0; i < length; i += PGSIZE)
+    {
+      struct page *p = page_lookup (base + i);
+
+      /* A page of a shared mapping that went to swap holds the
+         only copy of its data. */
+      if (p == NULL || (p->shared && p->type != PAGE_FILE))
+        continue;
+
+      if (p->shared && !p->cached && p->kpage != NULL
+          && (p->dirty || pagedir_is_dirty (p->pd, p->upage)))
+        file_write_at (p->file, p->kpage, p->read_bytes, p->ofs);
+      release_page (p);
+      p->dirty = false;
+      p->type = p->file != NULL ? PAGE_FILE : PAGE_ZERO;
+    }
+  frame_unlock ();
+  pagedir_batch_end (&batch);
+}
+
+/* Sets whether faults on the file pages covering LENGTH bytes at
+   UPAGE read ahead the pages that follow, for madvise(). */
+void
+page_set_sequential (void *upage, size_t length, bool sequential)
+{
+  uint8_t *base = upage;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  for (size_t i = 0; i < length; i += PGSIZE)
+    {
+      struct page *p = page_lookup (base + i);
+      if (p != NULL)
+        p->sequential = sequential;
+    }
+}
+
+/* Brings the pages covering LENGTH bytes at UPAGE into memory
+   in address order, as if each had been touched: written to if
+   it is writable, so that blank pages get frames of their own,
+   or else read.  Stops early if memory runs short. */
+void
+page_populate_range (void *upage, size_t length)
+{
+  uint8_t *base = upage;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  for (size_t i = 0; i < length; i += PGSIZE)
+    {
+      struct page *p = page_lookup (base + i);
+      if (p != NULL && !load_page (p, p->writable))
+        break;
+    }
+}
+
+/* Brings the page at UPAGE into memory.  A blank page that is
+   only being read, as WRITE tells, gets the shared zero page.
+   Returns false if the current process has no page there. */
+bool
+page_load (void *upage, bool write)
+{
+  struct page *p = page_lookup (upage);
+
+  if (p == NULL || !load_page (p, write))
+    return false;
+  if (p->sequential)
+    read_ahead (p);
+  return true;
+}
+
+/* Brings page P into memory, as page_load() does.  Returns false
+   if memory is short. */
+static bool
+load_page (struct page *p, bool write)
+{
+  enum page_type type;
+  bool present;
+  bool pinned = false;
+  void *kpage = NULL;
+
+  /* If the page is being evicted, the frame table lock is held
+     until it has been written out. */
+  frame_lock ();
+  present = p->kpage != NULL;
+  type = p->type;
+  frame_unlock ();
+  if (present)
+    return true;
+
+  /* Pages that are not present are left alone by the frame
+     table, so the lock need not be held while reading. */
+  switch (type)
+    {
+    case PAGE_ZERO:
+      kpage = write ? palloc_get_page (PAL_USER | PAL_ZERO) : zero_page;
+      break;
+    case PAGE_FILE:
+      kpage = load_file_page (p, &pinned);
+      break;
+    case PAGE_SWAP:
+      return load_swap_pages (p);
+    }
+  if (kpage == NULL)
+    return false;
+
+  frame_lock ();
+  if (!install_page (p, kpage))
+    {
+      if (pinned)
+        {
+          frame_map (kpage, p);
+          frame_unpin (kpage);
+          pcache_put (kpage, p, false);
+        }
+      else if (kpage != zero_page)
+        palloc_free_page (kpage);
+      frame_unlock ();
+      return false;
+    }
+  if (pinned)
+    frame_unpin (kpage);
+  frame_unlock ();
+
+  return true;
+}
+
+/* Resolves a write fault on the page at UPAGE, if it is writable
+   but shares its frame with another process since fork() or maps
+   the zero page, by giving it a private copy.  Returns true if
+   the faulting access should be retried, false if it was a
+   genuine protection violation. */
+bool
+page_copy_on_write (void *upage)
+{
+  struct page *p = page_lookup (upage);
+  void *kpage, *copy;
+  bool retry = true;
+
+  if (p == NULL || !p->writable)
+    return false;
+
+  frame_lock ();
+  kpage = p->kpage;
+  if (kpage == NULL || pagedir_is_writable (p->pd, p->upage))
+    {
+      /* Evicted or resolved while we waited for the lock. */
+    }
+  else if (kpage != zero_page && !frame_is_shared (kpage))
+    pagedir_set_writable (p->pd, p->upage, true);
+  else
+    {
+      frame_pin (kpage);
+      copy = palloc_get_page (PAL_USER);
+      frame_unpin (kpage);
+      if (copy == NULL)
+        retry = false;
+      else
+        {
+          memcpy (copy, kpage, PGSIZE);
+          frame_unmap (kpage, p);
+          pagedir_clear_page (p->pd, p->upage);
+          pagedir_set_page (p->pd, p->upage, copy, true);
+          p->kpage = copy;
+          frame_map (copy, p);
+        }
+    }
+  frame_unlock ();
+
+  return retry;
+}
+
+/* Unmaps P, whose frame is being evicted, leaving it to be
+   reloaded from its backing store.  Called by the frame table
+   with its lock held. */
+void
+page_drop (struct page *p)
+{
+  ASSERT (p->kpage != NULL);
+
+  p->dirty = p->dirty || pagedir_is_dirty (p->pd, p->upage);
+  pagedir_clear_page (p->pd, p->upage);
+  p->kpage = NULL;
+}
+
+/* Unmaps P, whose frame is being evicted and has been saved to
+   swap slot SWAP_IDX.  Called by the frame table with its lock
+   held. */
+void
+page_save_to_swap (struct page *p, size_t swap_idx)
+{
+  ASSERT (swap_is_valid (swap_idx));
+
+  page_drop (p);
+  p->type = PAGE_SWAP;
+  p->swap_idx = swap_idx;
+}
+
+/* Returns the current process's page at UPAGE, or a null pointer
+   if there is none. */
+static struct page *
+page_lookup (const void *upage)
+{
+  struct page key;
+  struct hash_elem *e;
+
+  key.upage = pg_round_down (upage);
+  e = hash_find (&thread_current ()->pages, &key.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Adds a page of zeros at UPAGE to the current process and
+   returns it, or returns a null pointer if UPAGE is already in
+   use or memory allocation fails. */
+static struct page *
+page_create (void *upage, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  if (!is_user_vaddr (upage) || page_lookup (upage) != NULL)
+    return NULL;
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+
+  p->upage = upage;
+  p->pd = t->pagedir;
+  p->kpage = NULL;
+  p->writable = writable;
+  p->dirty = false;
+  p->type = PAGE_ZERO;
+  p->file = NULL;
+  p->shared = false;
+  p->cached = false;
+  p->sequential = false;
+  hash_insert (&t->pages, &p->elem);
+  return p;
+}
+
+/* Releases the frame or swap slot of P and frees it.  The frame
+   table lock must be held. */
+static void
+free_page (struct page *p)
+{
+  release_page (p);
+  free (p);
+}
+
+/* Unmaps P and releases its frame or swap slot, leaving it not
+   present.  The frame table lock must be held. */
+static void
+release_page (struct page *p)
+{
+  if (p->kpage != NULL)
+    {
+      bool dirty = pagedir_is_dirty (p->pd, p->upage);
+
+      pagedir_clear_page (p->pd, p->upage);
+      if (p->cached)
+        pcache_put (p->kpage, p, dirty);
+      else if (p->kpage != zero_page && !frame_unmap (p->kpage, p))
+        palloc_free_page (p->kpage);
+      p->kpage = NULL;
+    }
+  else if (p->type == PAGE_SWAP)
+    swap_destroy_page (p->swap_idx);
+}
+
+/* Reads in the pages that follow file page P in its mapping, up
+   to FILE_READAHEAD in all, while they are marked sequential, so
+   that a process streaming through a file faults once per run
+   instead of once per page. */
+static void
+read_ahead (struct page *p)
+{
+  if (p->type != PAGE_FILE)
+    return;
+
+  for (size_t i = 1; i < FILE_READAHEAD; i++)
+    {
+      struct page *q = page_lookup ((uint8_t *) p->upage + i * PGSIZE);
+
+      if (q == NULL || q->type != PAGE_FILE || q->file != p->file
+          || !q->sequential || !load_page (q, false))
+        break;
+    }
+}
+
+/* Maps P, which is not present, to frame KPAGE, read-only if
+   KPAGE is the zero page.  Returns false if memory allocation
+   fails.  The frame table lock must be held. */
+static bool
+install_page (struct page *p, void *kpage)
+{
+  bool writable = p->writable && kpage != zero_page;
+
+  if (!pagedir_set_page (p->pd, p->upage, kpage, writable))
+    return false;
+  p->kpage = kpage;
+  frame_map (kpage, p);
+  return true;
+}
+
+/* Reads swapped-out page P back in, along with the pages around
+   it that were swapped out to adjacent slots, as eviction does
+   for idle neighbouring pages.  Returns true if P was loaded.  A
+   page that cannot be mapped stays in swap. */
+static bool
+load_swap_pages (struct page *p)
+{
+  struct page *run[SWAP_READAHEAD];
+  void *kpages[SWAP_READAHEAD];
+  size_t cnt, pos, first;
+
+  frame_lock ();
+  cnt = gather_readahead (p, run, &pos);
+  first = p->swap_idx - pos;
+  frame_unlock ();
+
+  for (size_t i = 0; i < cnt; i++)
+    {
+      kpages[i] = palloc_get_page (PAL_USER);
+      if (kpages[i] == NULL)
+        {
+          while (i-- > 0)
+            palloc_free_page (kpages[i]);
+          return false;
+        }
+    }
+
+  /* Loading drops a reference to each slot.  Take another first,
+     and drop it only once the page is mapped, so that a page that
+     cannot be mapped keeps its slot. */
+  for (size_t i = 0; i < cnt; i++)
+    swap_dup_page (first + i);
+  swap_load_multiple (first, kpages, cnt);
+
+  frame_lock ();
+  for (size_t i = 0; i < cnt; i++)
+    if (install_page (run[i], kpages[i]))
+      swap_destroy_page (first + i);
+    else
+      palloc_free_page (kpages[i]);
+  frame_unlock ();
+
+  return p->kpage != NULL;
+}
+
+/* Fills RUN with swapped-out page P and the pages at adjacent
+   addresses that are in adjacent swap slots, in address order,
+   and returns their number.  P's index in RUN is stored in *POS.
+   The frame table lock must be held. */
+static size_t
+gather_readahead (struct page *p, struct page *run[SWAP_READAHEAD],
+                  size_t *pos)
+{
+  struct page *first;
+  size_t before = 0, after = 0;
+
+  while (1 + before + after < SWAP_READAHEAD
+         && swap_neighbour (p, after + 1) != NULL)
+    after++;
+  while (1 + before + after < SWAP_READAHEAD
+         && swap_neighbour (p, -(int) (before + 1)) != NULL)
+    before++;
+
+  first = before > 0 ? swap_neighbour (p, -(int) before) : p;
+  for (size_t i = 0; i < before + after + 1; i++)
+    run[i] = page_lookup ((uint8_t *) first->upage + i * PGSIZE);
+  *pos = before;
+  return before + after + 1;
+}
+
+/* Returns the page DISTANCE pages away from swapped-out page P
+   if it is swapped out as well, DISTANCE slots away from P's
+   slot.  Otherwise, returns a null pointer. */
+static struct page *
+swap_neighbour (struct page *p, int distance)
+{
+  uintptr_t addr = (uintptr_t) p->upage + distance * PGSIZE;
+  struct page *q;
+
+  if ((distance < 0 && addr > (uintptr_t) p->upage)
+      || !is_user_vaddr ((void *) addr))
+    return NULL;
+  q = page_lookup ((void *) addr);
+  if (q == NULL || q->kpage != NULL || q->type != PAGE_SWAP
+      || q->swap_idx != p->swap_idx + distance)
+    return NULL;
+  return q;
+}
+
+/* Reads file page P into a new frame, or gets it from the page
+   cache, in which case the frame comes back pinned and *PINNED
+   is set to true.  Returns a null pointer on failure. */
+static void *
+load_file_page (struct page *p, bool *pinned)
+{
+  struct file *file = p->file;
+  void *kpage;
+  bool locked;
+
+  if (p->cached)
+    {
+      kpage = pcache_get (file, p->ofs, p->read_bytes, p->shared);
+      if (kpage != NULL)
+        {
+          *pinned = true;
+          return kpage;
+        }
+      p->cached = false;
+    }
+
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return NULL;
+  locked = user_io_block_nested ();
+  file_read_at (file, kpage, p->read_bytes, p->ofs);
+  if (locked)
+    user_io_release ();
+  return kpage;
+}
+
+static void
+destroy_page (struct hash_elem *e, void *aux UNUSED)
+{
+  free_page (hash_entry (e, struct page, elem));
+}
+
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_int (pg_no (p->upage));
+}
+
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+
+  return a->upage < b->upage;
+}
@@ -0,0 +1,72 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "filesys/off_t.h"
+#include "threads/thread.h"
+
+/* Where the contents of a page come from while it is not in
+   memory. */
+enum page_type
+  {
+    PAGE_ZERO,                  /* Fresh page, all zeros. */
+    PAGE_FILE,                  /* Part of a memory mapping. */
+    PAGE_SWAP                   /* Saved in a swap slot. */
+  };
+
+/* A user page, one entry of a process's supplemental page
+   table. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    uint32_t *pd;               /* Page directory of the owner. */
+    void *kpage;                /* Frame, or null if not present. */
+    bool writable;              /* Writable by the user process? */
+    bool dirty;                 /* Written before being evicted? */
+    enum page_type type;        /* Backing store. */
+
+    /* PAGE_FILE. */
+    struct file *file;          /* Mapped file. */
+    off_t ofs;                  /* Offset in the mapped file. */
+    size_t read_bytes;          /* Bytes to read, rest is zeroed. */
+    bool shared;                /* Written back to the file? */
+    bool cached;                /* Shared through the page cache? */
+    bool sequential;            /* Read ahead on faults? */
+
+    /* PAGE_SWAP. */
+    size_t swap_idx;            /* Swap slot. */
+
+    struct hash_elem elem;      /* Element in thread's pages. */
+    struct list_elem frame_elem; /* Element in frame's mappings. */
+  };
+
+void page_init          (void);
+void *page_zero_frame   (void);
+
+bool page_table_init    (void);
+void page_table_destroy (void);
+bool page_table_fork    (struct thread *parent);
+
+bool page_add_zero      (void *upage, bool writable);
+bool page_add_file      (void *upage, struct file *, off_t ofs,
+                         size_t length, bool writable, bool shared);
+void page_set_file      (void *upage, size_t length, struct file *);
+void page_remove_range  (void *upage, size_t length);
+bool page_is_dirty      (const void *upage);
+void page_sync_range    (void *upage, size_t length);
+void page_discard_range (void *upage, size_t length);
+void page_set_sequential (void *upage, size_t length, bool sequential);
+void page_populate_range (void *upage, size_t length);
+
+bool page_load          (void *upage, bool write);
+bool page_copy_on_write (void *upage);
+
+void page_drop          (struct page *);
+void page_save_to_swap  (struct page *, size_t swap_idx);
+
+#endif /* vm/page.h */
@@ -0,0 +1,79 @@
+#include "vm/pageout.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/frame.h"
+
+/* Page-out daemon.
+
+   A kernel thread that keeps a reserve of free user frames, so
+   that page faults rarely have to evict synchronously.  It is
+   woken when the number of free frames drops below the low
+   watermark and evicts frames with the frame table's clock,
+   which takes clean frames before dirty ones, until the high
+   watermark is reached again. */
+
+static size_t low_wm, high_wm;          /* Watermarks, in frames. */
+static struct semaphore wakeup;         /* Upped to start a pass. */
+static bool started;                    /* Daemon running? */
+static bool busy;                       /* Pass in progress? */
+
+static thread_func pageout_daemon NO_RETURN;
+
+/* Starts the page-out daemon with watermarks LOW and HIGH, in
+   free user frames.  Zero selects a default based on the size of
+   the user pool. */
+void
+pageout_init (size_t low, size_t high)
+{
+  size_t frame_cnt = palloc_user_free ();
+
+  if (low == 0)
+    low = frame_cnt / 16;
+  if (high == 0)
+    high = low * 2;
+  if (high <= low)
+    high = low + 1;
+  if (high > frame_cnt)
+    high = frame_cnt;
+  low_wm = low;
+  high_wm = high;
+
+  sema_init (&wakeup, 0);
+  busy = false;
+  if (thread_create ("pageout", PRI_DEFAULT, pageout_daemon, NULL)
+      == TID_ERROR)
+    PANIC ("Couldn't start page-out daemon");
+  started = true;
+  printf ("pageout: low watermark %zu, high watermark %zu frames.\n",
+          low_wm, high_wm);
+}
+
+/* Wakes the daemon if free user frames are below the low
+   watermark. */
+void
+pageout_wake (void)
+{
+  if (started && !busy && palloc_user_free () < low_wm)
+    {
+      busy = true;
+      sema_up (&wakeup);
+    }
+}
+
+/* Evicts frames until the high watermark is reached or nothing
+   more can be evicted, then waits for the next wakeup. */
+static void
+pageout_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&wakeup);
+      while (palloc_user_free () < high_wm && frame_evict ())
+        continue;
+      busy = false;
+    }
+}
@@ -0,0 +1,9 @@
+#ifndef VM_PAGEOUT_H
+#define VM_PAGEOUT_H
+
+#include <stddef.h>
+
+void pageout_init (size_t low, size_t high);
+void pageout_wake (void);
+
+#endif /* vm/pageout.h */
@@ -0,0 +1,300 @@
+#include "vm/pcache.h"
+#include <debug.h>
+#include <hash.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "userprog/user-io.h"
+#include "vm/frame.h"
+
+/* Page cache of file pages mapped by more than one process.
+
+   Every process that runs the same executable maps the same
+   frame for each page of its read-only segments, and every
+   shared mapping (mmap()) of a file maps the same frame for each
+   page of the file, so that writes through one mapping are seen
+   at once through the others.  A cached page is identified by
+   the inode it was read from, its offset in the file, the number
+   of bytes read and whether it belongs to a shared mapping, and
+   it lives for as long as some page directory maps it.
+
+   Shared pages that have been written are written back to their
+   file, one page at a time, whenever a process unmaps them and
+   when the frame table evicts them.  Clean pages are simply
+   dropped on eviction.  Writing back takes the I/O lock, which is
+   never waited for with the frame table lock held.  If it is busy
+   when a process unmaps a page, the page stays dirty in the
+   cache, even once nobody maps it, until it is evicted.
+
+   The cache is protected by the frame table lock. */
+
+/* A cached page. */
+struct pcache_page
+  {
+    struct inode *inode;                /* Backing file. */
+    off_t ofs;                          /* Offset in file. */
+    size_t read_bytes;                  /* Bytes read from file. */
+    bool shared;                        /* Part of a shared mapping? */
+    bool dirty;                         /* Not written back yet? */
+    void *kpage;                        /* Frame holding the data. */
+    struct hash_elem elem;              /* Element in cache. */
+    struct hash_elem kpage_elem;        /* Element in cache_by_kpage. */
+  };
+
+static struct hash cache;               /* Indexed by file position. */
+static struct hash cache_by_kpage;      /* Indexed by frame. */
+
+static hash_hash_func pcache_hash;
+static hash_less_func pcache_less;
+static hash_hash_func pcache_kpage_hash;
+static hash_less_func pcache_kpage_less;
+static struct pcache_page *lookup_kpage (void *kpage);
+static void remove_page (struct pcache_page *);
+static bool write_back (struct pcache_page *);
+
+/* Initializes the page cache. */
+void
+pcache_init (void)
+{
+  hash_init (&cache, pcache_hash, pcache_less, NULL);
+  hash_init (&cache_by_kpage, pcache_kpage_hash, pcache_kpage_less, NULL);
+}
+
+/* Returns a frame holding READ_BYTES bytes of FILE read from
+   offset OFS, followed by zeros, reading it in if it is not
+   cached yet.  SHARED tells whether the frame is for a shared
+   mapping, which may write to it, or for a read-only one.  The
+   frame is returned pinned: the caller must record its mapping
+   with frame_map() and then frame_unpin() it.  Returns a null
+   pointer if memory is short. */
+void *
+pcache_get (struct file *file, off_t ofs, size_t read_bytes, bool shared)
+{
+  struct pcache_page key, *p;
+  struct hash_elem *e;
+  void *kpage;
+  bool locked;
+
+  key.inode = file_get_inode (file);
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+  key.shared = shared;
+  key.dirty = false;
+
+  frame_lock ();
+  e = hash_find (&cache, &key.elem);
+  if (e != NULL)
+    {
+      kpage = hash_entry (e, struct pcache_page, elem)->kpage;
+      frame_pin (kpage);
+      frame_unlock ();
+      return kpage;
+    }
+  frame_unlock ();
+
+  /* Read the page without holding the frame table lock, so that
+     other processes can fault and evict in the meantime. */
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  locked = user_io_block_nested ();
+  file_read_at (file, kpage, read_bytes, ofs);
+  if (locked)
+    user_io_release ();
+
+  *p = key;
+  p->kpage = kpage;
+
+  frame_lock ();
+  e = hash_insert (&cache, &p->elem);
+  if (e != NULL)
+    {
+      /* Someone else read the same page first. */
+      palloc_free_page (kpage);
+      free (p);
+      kpage = hash_entry (e, struct pcache_page, elem)->kpage;
+    }
+  else
+    {
+      hash_insert (&cache_by_kpage, &p->kpage_elem);
+      frame_set_cached (kpage);
+    }
+  frame_pin (kpage);
+  frame_unlock ();
+
+  return kpage;
+}
+
+/* Drops the mapping of cached frame KPAGE by user page PAGE, and
+   frees the frame once nobody maps it anymore.  DIRTY tells
+   whether PAGE wrote to the frame, in which case it is written
+   back to its file now if the I/O lock is held by the caller or
+   free, and left to eviction otherwise. */
+void
+pcache_put (void *kpage, struct page *page, bool dirty)
+{
+  struct pcache_page *p;
+  bool in_use;
+
+  frame_lock ();
+  p = lookup_kpage (kpage);
+  ASSERT (p != NULL);
+  p->dirty = p->dirty || dirty;
+  in_use = frame_unmap (kpage, page);
+  if (p->dirty && (dirty || !in_use))
+    write_back (p);
+  if (!in_use && !p->dirty)
+    remove_page (p);
+  frame_unlock ();
+}
+
+/* Returns true if cached frame KPAGE has been written to and not
+   written back since. */
+bool
+pcache_is_dirty (void *kpage)
+{
+  struct pcache_page *p;
+  bool dirty;
+
+  frame_lock ();
+  p = lookup_kpage (kpage);
+  ASSERT (p != NULL);
+  dirty = p->dirty;
+  frame_unlock ();
+  return dirty;
+}
+
+/* Writes cached frame KPAGE back to its file if it has been
+   written to, as DIRTY tells for mappings whose dirty bits the
+   caller has just cleared, and not written back since.  The
+   caller must hold the I/O lock. */
+void
+pcache_sync (void *kpage, bool dirty)
+{
+  struct pcache_page *p;
+
+  frame_lock ();
+  p = lookup_kpage (kpage);
+  ASSERT (p != NULL);
+  if (dirty || p->dirty)
+    {
+      bool written UNUSED = write_back (p);
+      ASSERT (written);
+    }
+  frame_unlock ();
+}
+
+/* Removes cached frame KPAGE, whose mappings have all been torn
+   down by the frame table, from the cache and frees it.  If
+   DIRTY, the page is written back to its file first; the caller
+   must hold the I/O lock. */
+void
+pcache_evict (void *kpage, bool dirty)
+{
+  struct pcache_page *p;
+
+  frame_lock ();
+  p = lookup_kpage (kpage);
+  ASSERT (p != NULL);
+  if (dirty)
+    {
+      bool written UNUSED;
+
+      p->dirty = true;
+      written = write_back (p);
+      ASSERT (written);
+    }
+  remove_page (p);
+  frame_unlock ();
+}
+
+/* Writes cached page P back to its file, unless the I/O lock is
+   held by another thread: whoever holds it may be waiting for the
+   frame table lock, which our caller holds.  Returns true if
+   successful, false if P was left dirty. */
+static bool
+write_back (struct pcache_page *p)
+{
+  bool locked = user_io_try_block ();
+
+  ASSERT (p->shared);
+  if (!locked && !user_io_held ())
+    return false;
+  inode_write_at (p->inode, p->kpage, p->read_bytes, p->ofs);
+  p->dirty = false;
+  if (locked)
+    user_io_release ();
+  return true;
+}
+
+/* Removes P from the cache and frees its frame. */
+static void
+remove_page (struct pcache_page *p)
+{
+  hash_delete (&cache, &p->elem);
+  hash_delete (&cache_by_kpage, &p->kpage_elem);
+  palloc_free_page (p->kpage);
+  free (p);
+}
+
+/* Returns the cached page held in frame KPAGE, or a null
+   pointer if there is none. */
+static struct pcache_page *
+lookup_kpage (void *kpage)
+{
+  struct pcache_page key;
+  struct hash_elem *e;
+
+  key.kpage = kpage;
+  e = hash_find (&cache_by_kpage, &key.kpage_elem);
+  return e != NULL ? hash_entry (e, struct pcache_page, kpage_elem) : NULL;
+}
+
+static unsigned
+pcache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct pcache_page *p = hash_entry (e, struct pcache_page, elem);
+  return (hash_bytes (&p->inode, sizeof p->inode) ^ hash_int (p->ofs)
+          ^ p->shared);
+}
+
+static bool
+pcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct pcache_page *a = hash_entry (a_, struct pcache_page, elem);
+  const struct pcache_page *b = hash_entry (b_, struct pcache_page, elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  if (a->shared != b->shared)
+    return a->shared < b->shared;
+  return a->read_bytes < b->read_bytes;
+}
+
+static unsigned
+pcache_kpage_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct pcache_page *p = hash_entry (e, struct pcache_page, kpage_elem);
+  return hash_bytes (&p->kpage, sizeof p->kpage);
+}
+
+static bool
+pcache_kpage_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                   void *aux UNUSED)
+{
+  const struct pcache_page *a
+    = hash_entry (a_, struct pcache_page, kpage_elem);
+  const struct pcache_page *b
+    = hash_entry (b_, struct pcache_page, kpage_elem);
+
+  return a->kpage < b->kpage;
+}
@@ -0,0 +1,19 @@
+#ifndef VM_PCACHE_H
+#define VM_PCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "filesys/file.h"
+
+struct page;
+
+void  pcache_init  (void);
+void *pcache_get   (struct file *, off_t ofs, size_t read_bytes,
+                    bool shared);
+void  pcache_put   (void *kpage, struct page *, bool dirty);
+bool  pcache_is_dirty (void *kpage);
+void  pcache_sync  (void *kpage, bool dirty);
+void  pcache_evict (void *kpage, bool dirty);
+
+#endif /* vm/pcache.h */
@@ -9,113 +9,287 @@
 #include <stdio.h>
 #include <string.h>
 #include "devices/block.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/loader.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "vm/zswap.h"
 
-/* TODO */
+/* Swap slot allocator.
+
+   Swap is made of up to MAX_AREAS areas, each a run of sectors
+   on one block device: a whole swap partition, or the sectors of
+   a preallocated swap file, which are read and written directly
+   without going through the file system.  The slots of all the
+   areas are numbered one after another, so the rest of the VM
+   sees a single array of slots.
+
+   Each area has a priority.  Allocation uses the areas of the
+   highest priority that have room, handing out successive
+   allocations (the clusters that eviction writes at once) to
+   each of them in turn, so that swap is spread evenly over them.
+   This does not make their I/O overlap: eviction writes one
+   cluster at a time, with the frame table lock held.  Within an
+   area, the search for free slots starts where the last one left
+   off, instead of at the beginning every time. */
+
+/* A swap area. */
+struct swap_area
+  {
+    char name[16];                      /* Device or file name. */
+    struct block *block;                /* Block device. */
+    block_sector_t start;               /* Sector of the first slot. */
+    size_t first_slot;                  /* Index of the first slot. */
+    size_t slot_cnt;                    /* Number of slots. */
+    size_t next_slot;                   /* Where to start searching. */
+    int prio;                           /* Higher priorities fill first. */
+  };
+
+/* Maximum number of swap areas. */
+#define MAX_AREAS 8
+
+/* Swap areas, in descending order of priority. */
+static struct swap_area areas[MAX_AREAS];
+static size_t area_cnt;
+
+/* Allocations so far, for taking turns among areas. */
+static size_t rotor;
 
 /* A swap page pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint16_t *ref_cnt;                  /* Pages referring to each slot. */
   };
 
-static struct block *swap_device;
-
 static struct pool swap_pool;
 
+static struct swap_area *add_area (const char *name, struct block *,
+                                   block_sector_t start, size_t slot_cnt,
+                                   int prio);
+static size_t alloc_in_area (struct swap_area *, size_t page_cnt);
+static size_t scan_area (struct swap_area *, size_t start, size_t page_cnt);
+static struct swap_area *slot_to_area (size_t page_idx);
 static void init_pool (struct pool *, size_t page_cnt, const char *name);
+static void transfer (size_t page_idx, void *const pages[], size_t page_cnt,
+                      bool write);
 
 #define SECTOR_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 
-/* Initializes the page allocator.  At most USER_PAGE_LIMIT
-   pages are put into the user pool. */
+/* Pages moved by one block device request. */
+#define PAGES_PER_REQUEST 8
+
+/* Adds all of block device BLOCK to swap, with priority PRIO.
+   Must be called before swap_init(). */
+void
+swap_add_device (struct block *block, int prio)
+{
+  add_area (block_name (block), block, 0,
+            block_size (block) / SECTOR_PER_PAGE, prio);
+}
+
+/* Adds file NAME to swap, with priority PRIO, creating it with
+   PAGE_CNT pages if it does not exist.  The file's sectors must
+   be contiguous.  The file stays open, and closed to writes,
+   from then on.  Must be called after the file system is
+   initialized and before swap_init(). */
+void
+swap_add_file (const char *name, size_t page_cnt, int prio)
+{
+  struct file *file;
+  struct inode *inode;
+  block_sector_t start;
+  off_t length;
+
+  if (page_cnt > 0)
+    filesys_create (name, page_cnt * PGSIZE);
+  file = filesys_open (name);
+  if (file == NULL)
+    {
+      printf ("swap: cannot open swap file \"%s\"\n", name);
+      return;
+    }
+
+  inode = file_get_inode (file);
+  length = ROUND_DOWN (file_length (file), PGSIZE);
+  start = inode_get_sector (inode, 0);
+  for (off_t ofs = 0; ofs < length; ofs += BLOCK_SECTOR_SIZE)
+    if (inode_get_sector (inode, ofs) != start + ofs / BLOCK_SECTOR_SIZE)
+      {
+        printf ("swap: swap file \"%s\" is not contiguous\n", name);
+        file_close (file);
+        return;
+      }
+
+  if (length == 0
+      || add_area (name, block_get_role (BLOCK_FILESYS), start,
+                   length / PGSIZE, prio) == NULL)
+    {
+      file_close (file);
+      return;
+    }
+  file_deny_write (file);
+}
+
+/* Initializes the swap slot allocator over the areas added so
+   far. */
 void
 swap_init (void)
 {
+  size_t slot_cnt = 0;
+
   ASSERT (PGSIZE % BLOCK_SECTOR_SIZE == 0);
-  swap_device = block_get_role (BLOCK_SWAP);
-  if (swap_device == NULL)
+  if (area_cnt == 0)
     {
-      printf ("No swap device detected");
+      printf ("No swap device detected\n");
       return;
     }
-  size_t free_pages = block_size (swap_device) / SECTOR_PER_PAGE;
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&swap_pool, free_pages, "swap pool");
+  for (struct swap_area *a = areas; a < areas + area_cnt; a++)
+    {
+      a->first_slot = a->next_slot = slot_cnt;
+      slot_cnt += a->slot_cnt;
+      printf ("swap: %s, %zu pages, priority %d\n",
+              a->name, a->slot_cnt, a->prio);
+    }
+  init_pool (&swap_pool, slot_cnt, "swap pool");
+  zswap_init ();
+}
+
+/* Returns true if there is swap space to page out to. */
+bool
+swap_available (void)
+{
+  return swap_pool.used_map != NULL;
 }
 
-/* TODO */
+/* Allocates PAGE_CNT contiguous swap slots, each with one
+   reference, and returns the index of the first.  Returns
+   BITMAP_ERROR if there is no such run of free slots. */
 size_t
-swap_store_multiple (const void *_pages, size_t page_cnt)
+swap_alloc_multiple (size_t page_cnt)
 {
-  const int8_t  *pages = _pages;
-  block_sector_t sector_idx;
-  size_t         page_idx;
+  size_t page_idx = BITMAP_ERROR;
+  size_t first, last;
 
-  ASSERT (pg_ofs (_pages) == 0);
-  if (swap_device == NULL)
-    return BITMAP_ERROR;
-  if (page_cnt == 0)
+  if (!swap_available () || page_cnt == 0)
     return BITMAP_ERROR;
 
   lock_acquire (&swap_pool.lock);
-  page_idx = bitmap_scan_and_flip (swap_pool.used_map, 0, page_cnt, false);
-  lock_release (&swap_pool.lock);
+  for (first = 0; first < area_cnt && page_idx == BITMAP_ERROR; first = last)
+    {
+      /* Areas FIRST...LAST-1 have the same priority.  Take turns. */
+      size_t cnt;
 
+      for (last = first + 1;
+           last < area_cnt && areas[last].prio == areas[first].prio; last++)
+        continue;
+      cnt = last - first;
+      for (size_t k = 0; k < cnt && page_idx == BITMAP_ERROR; k++)
+        page_idx = alloc_in_area (&areas[first + (rotor + k) % cnt],
+                                  page_cnt);
+    }
   if (page_idx != BITMAP_ERROR)
-    sector_idx = page_idx * SECTOR_PER_PAGE;
-  else
-    PANIC ("swap_save: out of pages");
-
-  for (size_t i=0; i < page_cnt * SECTOR_PER_PAGE; i++)
-    block_write (swap_device, sector_idx + i, pages + (i * BLOCK_SECTOR_SIZE));
+    {
+      for (size_t i = 0; i < page_cnt; i++)
+        swap_pool.ref_cnt[page_idx + i] = 1;
+      rotor++;
+    }
+  lock_release (&swap_pool.lock);
 
   return page_idx;
 }
 
-/* TODO */
-size_t
-swap_store_page     (const void *page)
+/* Writes PAGES[0...PAGE_CNT-1] to the PAGE_CNT slots starting at
+   PAGE_IDX.  Pages that the compressed cache accepts stay in
+   memory; the rest go to disk with as few requests as possible. */
+void
+swap_write_multiple (size_t page_idx, void *const pages[], size_t page_cnt)
 {
-  return swap_store_multiple (page, 1);
+  size_t run = 0;
+
+  for (size_t i = 0; i < page_cnt; i++)
+    if (zswap_store (page_idx + i, pages[i]))
+      {
+        transfer (page_idx + i - run, pages + i - run, run, true);
+        run = 0;
+      }
+    else
+      run++;
+  transfer (page_idx + page_cnt - run, pages + page_cnt - run, run, true);
 }
 
-/* TODO */
+/* Writes PAGE to slot PAGE_IDX on disk, bypassing the compressed
+   cache.  Used by the cache to make room. */
 void
-swap_load_multiple  (size_t page_idx, void *_pages, size_t page_cnt)
+swap_write_back (size_t page_idx, void *page)
 {
-  int8_t *pages = _pages;
-  size_t  sector_idx = page_idx * SECTOR_PER_PAGE;
+  transfer (page_idx, &page, 1, true);
+}
 
-  ASSERT (pg_ofs (_pages) == 0);
-  if (swap_device == NULL)
-    return;
-  if (_pages == NULL || page_cnt == 0)
-    return;
+/* Stores PAGE in a newly allocated swap slot and returns its
+   index.  Panics if swap is full. */
+size_t
+swap_store_page (const void *page)
+{
+  size_t page_idx = swap_alloc_multiple (1);
+  void *pages[1] = { (void *) page };
+
+  if (page_idx == BITMAP_ERROR)
+    PANIC ("swap_store: out of pages");
+  swap_write_multiple (page_idx, pages, 1);
+  return page_idx;
+}
 
-  for (size_t i=0; i < page_cnt * SECTOR_PER_PAGE; i++)
-    block_read (swap_device, sector_idx + i, pages + (i * BLOCK_SECTOR_SIZE));
+/* Reads the PAGE_CNT slots starting at PAGE_IDX into
+   PAGES[0...PAGE_CNT-1] and drops one reference to each. */
+void
+swap_load_multiple (size_t page_idx, void *const pages[], size_t page_cnt)
+{
+  if (!swap_available () || page_cnt == 0)
+    return;
 
   ASSERT (bitmap_all (swap_pool.used_map, page_idx, page_cnt));
+  size_t run = 0;
+  for (size_t i = 0; i < page_cnt; i++)
+    if (zswap_load (page_idx + i, pages[i]))
+      {
+        transfer (page_idx + i - run, pages + i - run, run, false);
+        run = 0;
+      }
+    else
+      run++;
+  transfer (page_idx + page_cnt - run, pages + page_cnt - run, run, false);
   swap_destroy_multiple (page_idx, page_cnt);
 }
 
-/* Frees the page at PAGE. */
+/* Reads slot PAGE_IDX into PAGE and drops one reference to it. */
 void
-swap_load_page      (size_t page_idx, void *page)
+swap_load_page (size_t page_idx, void *page)
 {
-  swap_load_multiple (page_idx, page, 1);
+  swap_load_multiple (page_idx, &page, 1);
 }
 
+/* Drops one reference to each of the PAGE_COUNT slots starting
+   at PAGE_IDX, freeing the slots nobody refers to anymore. */
 void
 swap_destroy_multiple (size_t page_idx, size_t page_count)
 {
-  bitmap_set_multiple (swap_pool.used_map, page_idx, page_count, false);
+  lock_acquire (&swap_pool.lock);
+  for (size_t i = page_idx; i < page_idx + page_count; i++)
+    {
+      ASSERT (swap_pool.ref_cnt[i] > 0);
+      if (--swap_pool.ref_cnt[i] == 0)
+        {
+          zswap_invalidate (i);
+          bitmap_reset (swap_pool.used_map, i);
+        }
+    }
+  lock_release (&swap_pool.lock);
 }
 
 void
@@ -124,10 +298,98 @@ swap_destroy_page (size_t page_idx)
   swap_destroy_multiple(page_idx, 1);
 }
 
+/* Adds a reference to slot PAGE_IDX, which is now shared by one
+   more page table entry.  Loading or destroying the slot drops
+   one reference; the slot is freed when the last one goes. */
+void
+swap_dup_page (size_t page_idx)
+{
+  lock_acquire (&swap_pool.lock);
+  ASSERT (swap_pool.ref_cnt[page_idx] > 0);
+  swap_pool.ref_cnt[page_idx]++;
+  lock_release (&swap_pool.lock);
+}
+
 bool
 swap_is_valid (size_t page_idx)
 {
-  return page_idx < bitmap_size (swap_pool.used_map);
+  return swap_available () && page_idx < bitmap_size (swap_pool.used_map);
+}
+
+/* Adds an area named NAME of SLOT_CNT slots, starting at sector
+   START on BLOCK, with priority PRIO, keeping the areas sorted
+   by priority.  Returns the new area, or a null pointer if there
+   are too many areas. */
+static struct swap_area *
+add_area (const char *name, struct block *block, block_sector_t start,
+          size_t slot_cnt, int prio)
+{
+  struct swap_area *a;
+
+  ASSERT (!swap_available ());
+  if (area_cnt >= MAX_AREAS)
+    {
+      printf ("swap: too many swap areas, ignoring %s\n", name);
+      return NULL;
+    }
+
+  /* Areas added earlier come first among equal priorities. */
+  for (a = areas + area_cnt; a > areas && a[-1].prio < prio; a--)
+    a[0] = a[-1];
+  area_cnt++;
+
+  strlcpy (a->name, name, sizeof a->name);
+  a->block = block;
+  a->start = start;
+  a->slot_cnt = slot_cnt;
+  a->prio = prio;
+  return a;
+}
+
+/* Allocates PAGE_CNT contiguous slots in area A, searching from
+   where the last allocation in A ended and then from A's start.
+   Returns the first slot's index, or BITMAP_ERROR.  The pool lock
+   must be held. */
+static size_t
+alloc_in_area (struct swap_area *a, size_t page_cnt)
+{
+  size_t page_idx = scan_area (a, a->next_slot, page_cnt);
+
+  if (page_idx == BITMAP_ERROR && a->next_slot != a->first_slot)
+    page_idx = scan_area (a, a->first_slot, page_cnt);
+  if (page_idx == BITMAP_ERROR)
+    return BITMAP_ERROR;
+
+  bitmap_set_multiple (swap_pool.used_map, page_idx, page_cnt, true);
+  a->next_slot = page_idx + page_cnt;
+  if (a->next_slot == a->first_slot + a->slot_cnt)
+    a->next_slot = a->first_slot;
+  return page_idx;
+}
+
+/* Returns the first of PAGE_CNT free slots in a row in area A, at
+   or after slot START, or BITMAP_ERROR if there are none. */
+static size_t
+scan_area (struct swap_area *a, size_t start, size_t page_cnt)
+{
+  size_t end = a->first_slot + a->slot_cnt;
+  size_t page_idx;
+
+  if (page_cnt > end - start)
+    return BITMAP_ERROR;
+  page_idx = bitmap_scan (swap_pool.used_map, start, page_cnt, false);
+  return page_idx != BITMAP_ERROR && page_idx + page_cnt <= end
+         ? page_idx : BITMAP_ERROR;
+}
+
+/* Returns the area that holds slot PAGE_IDX. */
+static struct swap_area *
+slot_to_area (size_t page_idx)
+{
+  for (struct swap_area *a = areas; a < areas + area_cnt; a++)
+    if (page_idx - a->first_slot < a->slot_cnt)
+      return a;
+  NOT_REACHED ();
 }
 
 /* Initializes pool P as starting at START and ending at END,
@@ -138,9 +400,11 @@ init_pool (struct pool *p, size_t page_cnt, const char *name)
   void *bbuf;
 
   size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  size_t rc_pages = DIV_ROUND_UP (page_cnt * sizeof *p->ref_cnt, PGSIZE);
   bbuf = palloc_get_multiple (PAL_ZERO, bm_pages);
+  p->ref_cnt = palloc_get_multiple (PAL_ZERO, rc_pages);
 
-  if (bbuf == NULL)
+  if (bbuf == NULL || p->ref_cnt == NULL)
     PANIC ("Not enough memory for %s bitmap.", name);
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
@@ -149,3 +413,36 @@ init_pool (struct pool *p, size_t page_cnt, const char *name)
   lock_init (&p->lock);
   p->used_map = bitmap_create_in_buf (page_cnt, bbuf, bm_pages * PGSIZE);
 }
+
+/* Reads or writes, according to WRITE, the PAGE_CNT slots
+   starting at PAGE_IDX from or to PAGES.  Consecutive slots in
+   one area are consecutive on disk, so up to PAGES_PER_REQUEST
+   of them go to the device as a single request. */
+static void
+transfer (size_t page_idx, void *const pages[], size_t page_cnt, bool write)
+{
+  void *sectors[PAGES_PER_REQUEST * SECTOR_PER_PAGE];
+
+  while (page_cnt > 0)
+    {
+      struct swap_area *a;
+      block_sector_t sector;
+      size_t n = page_cnt < PAGES_PER_REQUEST ? page_cnt : PAGES_PER_REQUEST;
+
+      ASSERT (swap_is_valid (page_idx + n - 1));
+      a = slot_to_area (page_idx);
+      if (n > a->first_slot + a->slot_cnt - page_idx)
+        n = a->first_slot + a->slot_cnt - page_idx;
+      sector = a->start + (page_idx - a->first_slot) * SECTOR_PER_PAGE;
+      for (size_t i = 0; i < n * SECTOR_PER_PAGE; i++)
+        sectors[i] = (uint8_t *) pages[i / SECTOR_PER_PAGE]
+                     + (i % SECTOR_PER_PAGE) * BLOCK_SECTOR_SIZE;
+      if (write)
+        block_write_multiple (a->block, sector, sectors, n * SECTOR_PER_PAGE);
+      else
+        block_read_multiple (a->block, sector, sectors, n * SECTOR_PER_PAGE);
+      page_idx += n;
+      pages += n;
+      page_cnt -= n;
+    }
+}
@@ -4,15 +4,23 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+struct block;
+
+void   swap_add_device (struct block *, int prio);
+void   swap_add_file (const char *name, size_t page_cnt, int prio);
 void   swap_init (void);
+bool   swap_available (void);
 
+size_t swap_alloc_multiple (size_t page_cnt);
+void   swap_write_multiple (size_t, void *const pages[], size_t page_cnt);
+void   swap_write_back     (size_t, void *);
 size_t swap_store_page     (const void *);
-size_t swap_store_multiple (const void *, size_t page_cnt);
 void   swap_load_page      (size_t, void *);
-void   swap_load_multiple  (size_t, void *, size_t page_cnt);
+void   swap_load_multiple  (size_t, void *const pages[], size_t page_cnt);
 
 void   swap_destroy_multiple (size_t page_idx, size_t page_count);
 void   swap_destroy_page     (size_t page_idx);
+void   swap_dup_page         (size_t page_idx);
 
 bool   swap_is_valid (size_t);
 
@@ -0,0 +1,462 @@
+#include "vm/zswap.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/swap-alloc.h"
+
+/* Compressed swap cache.
+
+   Every page written to swap is first offered to this cache,
+   which compresses it and keeps it in a pool of kernel pages,
+   indexed by swap slot, instead of writing it to disk.  A page
+   filled with a single repeated word, such as an all-zero page,
+   is kept as that word alone and takes no space in the pool.
+   Once the pool is full, the pages stored longest ago are
+   written back to their swap slots to make room.
+
+   The pool packs up to two compressed pages into each kernel
+   page, one at each end, so freeing one never requires moving
+   the other.
+
+   Pages are compressed with a small LZ77 coder in the style of
+   LZF, which favours speed over ratio. */
+
+/* Most kernel pages the pool may use. */
+#define POOL_PAGES 64
+
+/* Pages that do not compress below this size go to disk. */
+#define MAX_ZSIZE (PGSIZE * 3 / 4)
+
+/* A kernel page in the pool. */
+struct zpage
+  {
+    uint8_t *data;                      /* The kernel page. */
+    struct zswap_entry *first;          /* Entry at start, or null. */
+    struct zswap_entry *last;           /* Entry at end, or null. */
+    struct list_elem elem;              /* Element in zpages. */
+  };
+
+/* A cached swap slot. */
+struct zswap_entry
+  {
+    size_t slot;                        /* Swap slot. */
+    struct zpage *zpage;                /* Data, or null if same-filled. */
+    size_t size;                        /* Compressed size in bytes. */
+    uint32_t fill;                      /* Fill word if same-filled. */
+    struct hash_elem elem;              /* Element in entries. */
+    struct list_elem lru_elem;          /* Element in lru. */
+  };
+
+static struct lock zswap_lock;          /* Protects everything below. */
+static struct hash entries;             /* Entries indexed by slot. */
+static struct list lru;                 /* Entries, oldest first. */
+static struct list zpages;              /* Pages in the pool. */
+static size_t zpage_cnt;                /* Number of pages in zpages. */
+static uint8_t *cbuf;                   /* Compression output. */
+static uint8_t *wbuf;                   /* Page being written back. */
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+static struct zswap_entry *lookup (size_t slot);
+static void remove_entry (struct zswap_entry *);
+static bool pool_alloc (struct zswap_entry *);
+static uint8_t *entry_data (const struct zswap_entry *);
+static bool write_back_oldest (void);
+static bool same_filled (const void *page, uint32_t *fill);
+static size_t lz_compress (const uint8_t *in, size_t in_len,
+                           uint8_t *out, size_t out_size);
+static bool lz_decompress (const uint8_t *in, size_t in_len,
+                           uint8_t *out, size_t out_len);
+
+/* Initializes the compressed swap cache. */
+void
+zswap_init (void)
+{
+  lock_init (&zswap_lock);
+  hash_init (&entries, entry_hash, entry_less, NULL);
+  list_init (&lru);
+  list_init (&zpages);
+  cbuf = palloc_get_page (PAL_ASSERT);
+  wbuf = palloc_get_page (PAL_ASSERT);
+}
+
+/* Tries to keep PAGE, which is about to be written to swap slot
+   SLOT, in the cache instead.  Returns true if successful, false
+   if the page must be written to disk by the caller. */
+bool
+zswap_store (size_t slot, const void *page)
+{
+  struct zswap_entry *e, *old;
+
+  e = malloc (sizeof *e);
+  if (e == NULL)
+    return false;
+  e->slot = slot;
+  e->zpage = NULL;
+  e->size = 0;
+  e->fill = 0;
+
+  lock_acquire (&zswap_lock);
+  old = lookup (slot);
+  if (old != NULL)
+    remove_entry (old);
+  if (!same_filled (page, &e->fill))
+    {
+      e->size = lz_compress (page, PGSIZE, cbuf, MAX_ZSIZE);
+      if (e->size == 0)
+        goto fail;
+      while (!pool_alloc (e))
+        if (!write_back_oldest ())
+          goto fail;
+      memcpy (entry_data (e), cbuf, e->size);
+    }
+  hash_insert (&entries, &e->elem);
+  list_push_back (&lru, &e->lru_elem);
+  lock_release (&zswap_lock);
+  return true;
+
+ fail:
+  lock_release (&zswap_lock);
+  free (e);
+  return false;
+}
+
+/* Reads swap slot SLOT into PAGE if it is in the cache and
+   returns true, or returns false if it must be read from disk.
+   The slot stays cached until it is invalidated. */
+bool
+zswap_load (size_t slot, void *page)
+{
+  struct zswap_entry *e;
+  bool success = false;
+
+  lock_acquire (&zswap_lock);
+  e = lookup (slot);
+  if (e != NULL)
+    {
+      if (e->zpage == NULL)
+        {
+          uint32_t *word = page;
+          for (size_t i = 0; i < PGSIZE / sizeof *word; i++)
+            word[i] = e->fill;
+        }
+      else if (!lz_decompress (entry_data (e), e->size, page, PGSIZE))
+        PANIC ("zswap: slot %zu is corrupt", slot);
+      success = true;
+    }
+  lock_release (&zswap_lock);
+  return success;
+}
+
+/* Forgets swap slot SLOT, which has been freed. */
+void
+zswap_invalidate (size_t slot)
+{
+  struct zswap_entry *e;
+
+  lock_acquire (&zswap_lock);
+  e = lookup (slot);
+  if (e != NULL)
+    remove_entry (e);
+  lock_release (&zswap_lock);
+}
+
+/* Writes the oldest entry that takes space in the pool back to
+   its swap slot and drops it.  Returns false if there is no such
+   entry. */
+static bool
+write_back_oldest (void)
+{
+  struct list_elem *le;
+
+  for (le = list_begin (&lru); le != list_end (&lru); le = list_next (le))
+    {
+      struct zswap_entry *e = list_entry (le, struct zswap_entry, lru_elem);
+      if (e->zpage != NULL)
+        {
+          if (!lz_decompress (entry_data (e), e->size, wbuf, PGSIZE))
+            PANIC ("zswap: slot %zu is corrupt", e->slot);
+          swap_write_back (e->slot, wbuf);
+          remove_entry (e);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Finds room for E->size bytes in the pool and assigns it to E.
+   Returns false if the pool is full. */
+static bool
+pool_alloc (struct zswap_entry *e)
+{
+  struct list_elem *le;
+  struct zpage *zp;
+
+  for (le = list_begin (&zpages); le != list_end (&zpages);
+       le = list_next (le))
+    {
+      size_t used;
+
+      zp = list_entry (le, struct zpage, elem);
+      if (zp->first != NULL && zp->last != NULL)
+        continue;
+      used = (zp->first != NULL ? zp->first->size : 0)
+             + (zp->last != NULL ? zp->last->size : 0);
+      if (PGSIZE - used >= e->size)
+        {
+          if (zp->first == NULL)
+            zp->first = e;
+          else
+            zp->last = e;
+          e->zpage = zp;
+          return true;
+        }
+    }
+
+  if (zpage_cnt >= POOL_PAGES)
+    return false;
+  zp = malloc (sizeof *zp);
+  if (zp == NULL)
+    return false;
+  zp->data = palloc_get_page (0);
+  if (zp->data == NULL)
+    {
+      free (zp);
+      return false;
+    }
+  zp->first = e;
+  zp->last = NULL;
+  list_push_back (&zpages, &zp->elem);
+  zpage_cnt++;
+  e->zpage = zp;
+  return true;
+}
+
+/* Returns the compressed data of E. */
+static uint8_t *
+entry_data (const struct zswap_entry *e)
+{
+  struct zpage *zp = e->zpage;
+  return zp->first == e ? zp->data : zp->data + PGSIZE - e->size;
+}
+
+/* Removes E from the cache, releasing its space in the pool. */
+static void
+remove_entry (struct zswap_entry *e)
+{
+  struct zpage *zp = e->zpage;
+
+  if (zp != NULL)
+    {
+      if (zp->first == e)
+        zp->first = NULL;
+      else
+        zp->last = NULL;
+      if (zp->first == NULL && zp->last == NULL)
+        {
+          list_remove (&zp->elem);
+          palloc_free_page (zp->data);
+          free (zp);
+          zpage_cnt--;
+        }
+    }
+  hash_delete (&entries, &e->elem);
+  list_remove (&e->lru_elem);
+  free (e);
+}
+
+/* Returns the entry for SLOT, or a null pointer if it is not
+   cached. */
+static struct zswap_entry *
+lookup (size_t slot)
+{
+  struct zswap_entry key;
+  struct hash_elem *e;
+
+  key.slot = slot;
+  e = hash_find (&entries, &key.elem);
+  return e != NULL ? hash_entry (e, struct zswap_entry, elem) : NULL;
+}
+
+/* Returns true and stores the word in *FILL if PAGE consists of
+   a single 32-bit word repeated. */
+static bool
+same_filled (const void *page, uint32_t *fill)
+{
+  const uint32_t *word = page;
+
+  for (size_t i = 1; i < PGSIZE / sizeof *word; i++)
+    if (word[i] != word[0])
+      return false;
+  *fill = word[0];
+  return true;
+}
+
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct zswap_entry, elem)->slot);
+}
+
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct zswap_entry, elem)->slot
+          < hash_entry (b, struct zswap_entry, elem)->slot);
+}
+
+/* LZ coder.
+
+   The compressed stream is a sequence of items, each introduced
+   by a control byte C:
+
+     - C < 32: C + 1 literal bytes follow.
+
+     - Otherwise, a back-reference.  L = C >> 5 is the length
+       minus 2, unless it is 7, in which case the next byte is
+       added to it.  The final byte holds the low 8 bits of the
+       distance minus 1, the low 5 bits of C the high bits. */
+
+#define LZ_HASH_BITS 10                 /* Size of match table. */
+#define LZ_MAX_LIT 32                   /* Longest literal run. */
+#define LZ_MAX_OFF (1 << 13)            /* Farthest back-reference. */
+#define LZ_MAX_LEN (7 + 255 + 2)        /* Longest back-reference. */
+
+/* Position + 1 of the last occurrence of each hashed 3-byte
+   sequence.  Protected by zswap_lock. */
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+static inline unsigned
+lz_hash (const uint8_t *p)
+{
+  uint32_t v = p[0] | p[1] << 8 | p[2] << 16;
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends literal runs for LIT[0...N-1] at *OP, not going past
+   END.  Returns false if they do not fit. */
+static bool
+lz_literals (uint8_t **op, const uint8_t *end, const uint8_t *lit, size_t n)
+{
+  while (n > 0)
+    {
+      size_t run = n < LZ_MAX_LIT ? n : LZ_MAX_LIT;
+
+      if ((size_t) (end - *op) < run + 1)
+        return false;
+      *(*op)++ = run - 1;
+      memcpy (*op, lit, run);
+      *op += run;
+      lit += run;
+      n -= run;
+    }
+  return true;
+}
+
+/* Compresses IN[0...IN_LEN-1] into OUT, which has room for
+   OUT_SIZE bytes.  Returns the compressed size, or 0 if it would
+   exceed OUT_SIZE. */
+static size_t
+lz_compress (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_size)
+{
+  const uint8_t *ip = in, *lit = in, *in_end = in + in_len;
+  uint8_t *op = out;
+  const uint8_t *out_end = out + out_size;
+
+  ASSERT (in_len < UINT16_MAX);
+
+  memset (lz_table, 0, sizeof lz_table);
+  while (in_end - ip >= 3)
+    {
+      unsigned h = lz_hash (ip);
+      const uint8_t *ref = in + lz_table[h] - 1;
+      bool hit = lz_table[h] != 0;
+
+      lz_table[h] = ip - in + 1;
+      if (hit && ip - ref <= LZ_MAX_OFF && !memcmp (ref, ip, 3))
+        {
+          size_t off = ip - ref - 1;
+          size_t max = in_end - ip;
+          size_t len = 3;
+
+          if (max > LZ_MAX_LEN)
+            max = LZ_MAX_LEN;
+          while (len < max && ref[len] == ip[len])
+            len++;
+
+          if (!lz_literals (&op, out_end, lit, ip - lit) || out_end - op < 3)
+            return 0;
+          if (len - 2 < 7)
+            *op++ = (len - 2) << 5 | off >> 8;
+          else
+            {
+              *op++ = 7 << 5 | off >> 8;
+              *op++ = len - 2 - 7;
+            }
+          *op++ = off & 0xff;
+
+          ip += len;
+          lit = ip;
+        }
+      else
+        ip++;
+    }
+  if (!lz_literals (&op, out_end, lit, in_end - lit))
+    return 0;
+  return op - out;
+}
+
+/* Decompresses IN[0...IN_LEN-1] into OUT, which must come out to
+   exactly OUT_LEN bytes.  Returns false if IN is malformed. */
+static bool
+lz_decompress (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+  const uint8_t *ip = in, *in_end = in + in_len;
+  uint8_t *op = out, *out_end = out + out_len;
+
+  while (ip < in_end)
+    {
+      unsigned ctrl = *ip++;
+
+      if (ctrl < LZ_MAX_LIT)
+        {
+          size_t n = ctrl + 1;
+
+          if (n > (size_t) (in_end - ip) || n > (size_t) (out_end - op))
+            return false;
+          memcpy (op, ip, n);
+          op += n;
+          ip += n;
+        }
+      else
+        {
+          size_t len = ctrl >> 5;
+          size_t off;
+
+          if (len == 7)
+            {
+              if (ip >= in_end)
+                return false;
+              len += *ip++;
+            }
+          len += 2;
+          if (ip >= in_end)
+            return false;
+          off = ((ctrl & 0x1f) << 8 | *ip++) + 1;
+          if (off > (size_t) (op - out) || len > (size_t) (out_end - op))
+            return false;
+
+          /* The reference may overlap the output, so copy bytewise. */
+          for (; len > 0; len--, op++)
+            *op = *(op - off);
+        }
+    }
+  return op == out_end;
+}
@@ -0,0 +1,12 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void zswap_init       (void);
+bool zswap_store      (size_t slot, const void *page);
+bool zswap_load       (size_t slot, void *page);
+void zswap_invalidate (size_t slot);
+
+#endif /* vm/zswap.h */